@@ -0,0 +1,1671 @@
+/******************************************************
+ * File: benchmarks.cpp
+ * Author: John Yang-Sammataro
+ *
+ * The benchmarks and differential checks of the evil hangman turn
+ * engine (see hangman.cpp), built into their own tool,
+ * evilHangmanBench, apart from the game.  Its commands take the same
+ * leading options as the game's (see ReadCommandOptions).
+ *
+ * "evilHangmanBench -simulate [games] [guesser] [threads] [guesses]" plays
+ * games of every length without prompting, using the frequency, random
+ * or entropy guesser (or "all"), and reports throughput, win rate and
+ * turn latency.  It is the standing benchmark for partition changes.
+ * "-record <file>" in front of it records the games to a replay log, and
+ * "evilHangmanBench -replay <log> [threads] [dictionary files]" plays the
+ * logged games again through the turn engine without prompting, on every
+ * core, checks that each turn reveals the pattern and leaves the pool size
+ * it did when it was recorded, and reports throughput and turn latency
+ * percentiles for diffing between builds.  The simulation shares one cache
+ * of partitioned turns between its games like the server does.
+ *
+ * "evilHangmanBench -loadtest <address> [clients] [games]" drives a game
+ * server with simulated players.
+ * "evilHangmanBench -scaling [threads]" benchmarks the speedup of
+ * partitioning large pools on several threads.
+ * "evilHangmanBench -lookahead [games] [depth] [guesser]" benchmarks the
+ * lookahead strategy's turn latency against search depth.
+ * "evilHangmanBench -checkbook" checks the opening book against live turns.
+ * "evilHangmanBench -bitset [games] [guesser]" checks turns on pools kept as
+ * bitsets (see CandidateBits), with and without the opening book, against
+ * turns on pools kept as lists and compares their speed.
+ * "evilHangmanBench -locality [games] [guesser]" times turns on the compiled
+ * dictionary's word order (see DictionaryWordOrder) against alphabetical
+ * order and counts the cache misses of each where the processor allows.
+ * "evilHangmanBench -snapshot [games] [guesser]" checks that game snapshots
+ * (see SaveHangmanGame) restore exactly and reports their size and speed.
+ * "evilHangmanBench -lengths" checks the per word length unrolled kernels
+ * (see WordLengthKernels) against the generic loops and times both by
+ * length.
+ * "evilHangmanBench -sampled" compares the sampled strategy's estimated
+ * largest families (see FindSampledWordFamily) with exact ones and reports
+ * how often they differ and the time saved, by word length.
+ * "evilHangmanBench -kernels" checks the SSE2 and AVX2 family mask kernels
+ * against the scalar one and reports masks per second for each, and
+ * "evilHangmanBench -memory [games]" reports resident memory per hosted
+ * game.  Built with -DCOUNT_ALLOCATIONS, "evilHangmanBench -alloccheck"
+ * checks that turns do not allocate.
+ */
+
+/* Include libraries and header files */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <csignal>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+/* Hardware cache events are counted through perf_event_open */
+#define HAVE_PERF_EVENTS
+#endif
+#include "hangman.h"
+using namespace std;
+
+/* Constants */
+/* Snapshots are timed over this many saves and restores */
+const int SNAPSHOT_BENCHMARK_RUNS = 100;
+const int SNAPSHOT_BENCHMARK_GAMES = 10;
+/* Replay threads claim this many logged games at a time */
+const long REPLAY_BATCH_GAMES = 64;
+const int LOAD_TEST_GUESSES = 10;
+const int SCALING_BENCHMARK_RUNS = 50;
+const int SIMULATION_GAMES = 100;
+const int SIMULATION_GUESSES = 10;
+const unsigned int SIMULATION_RANDOM_SEED = 106;
+const int KERNEL_BENCHMARK_RUNS = 10;
+const int LOOKAHEAD_BENCHMARK_GAMES = 1;
+const int LOOKAHEAD_BENCHMARK_DEPTH = 3;
+
+/* Types */
+
+/*
+ * CacheEvent, CacheCounters
+ * A hardware cache event by its perf_event_open type and config, and one
+ * counter per event in CACHE_EVENTS on the calling thread, counting user
+ * space only and only while started.  Events the kernel or processor cannot
+ * count (as in most virtual machines) are left with file -1, and without
+ * perf_event_open there are no files at all.
+ */
+struct CacheEvent {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+struct CacheCounters {
+    vector<int> files;
+};
+
+/*
+ * Guesser
+ * A letter picking strategy for the headless simulation.  guessLetter returns
+ * an unguessed letter for the game.  guesserScratch is working space owned by
+ * the calling thread and randomSeed its random number state.
+ */
+typedef char (*GuessLetterFunction)(WordBucket& wordBucket, HangmanGame& game, PartitionScratch& guesserScratch, unsigned int& randomSeed);
+
+struct Guesser {
+    const char* name;
+    GuessLetterFunction guessLetter;
+};
+
+/*
+ * SimulationWorker
+ * One simulation thread's share of the games of a word length and the
+ * results it has counted.  dictionaryChecksum is what its games are recorded
+ * with.
+ */
+struct SimulationWorker {
+    vector<WordBucket>* wordBuckets;
+    PartitionCache* partitionCache;
+    uint64_t dictionaryChecksum;
+    Guesser guesser;
+    int wordLength;
+    int games;
+    int guesses;
+    unsigned int randomSeed;
+    long wins;
+    long turns;
+    vector<long> latencyHistogram;
+};
+
+/*
+ * ReplayWorker
+ * One replay thread.  It claims logged games REPLAY_BATCH_GAMES at a time
+ * from nextRecord, record i of the log being the bytes from recordOffsets[i]
+ * to recordOffsets[i + 1] of logData, and plays each on whichever of
+ * dictionaries has the record's checksum.  It keeps the latency of every
+ * turn it replays, counts the games and turns replayed, the games that went
+ * differently from their records (describing the first) and the games
+ * skipped for having been played on a dictionary that is not loaded.
+ */
+struct ReplayWorker {
+    const char* logData;
+    vector<size_t>* recordOffsets;
+    volatile long* nextRecord;
+    vector<LoadedDictionary*>* dictionaries;
+    long games;
+    long turns;
+    long mismatches;
+    long skipped;
+    string firstMismatch;
+    vector<float> turnLatencies;
+};
+
+/* Function Prototypes */
+int RunLoadTest(string address, int clientCount, int gamesPerClient);
+int RunPartitionScaling(int maxThreads);
+char GuessByLetterFrequency(WordBucket& wordBucket, HangmanGame& game, PartitionScratch& guesserScratch, unsigned int& randomSeed);
+char GuessAtRandom(WordBucket& wordBucket, HangmanGame& game, PartitionScratch& guesserScratch, unsigned int& randomSeed);
+char GuessByEntropy(WordBucket& wordBucket, HangmanGame& game, PartitionScratch& guesserScratch, unsigned int& randomSeed);
+bool FindGuesser(string guesserName, Guesser& guesser);
+int GetLatencyBucket(double latencyMicroseconds);
+double GetLatencyPercentile(vector<long>& latencyHistogram, double percentile);
+void* SimulationWorkerMain(void* workerPointer);
+int RunFamilyMaskKernelBenchmark();
+int RunWordLengthKernelBenchmark();
+int RunCandidateBitsBenchmark(int gamesPerLength, string guesserName);
+void OpenCacheCounters(CacheCounters& cacheCounters);
+void StartCacheCounters(CacheCounters& cacheCounters);
+void StopCacheCounters(CacheCounters& cacheCounters);
+bool ReadCacheCounter(CacheCounters& cacheCounters, size_t event, uint64_t& count);
+void CloseCacheCounters(CacheCounters& cacheCounters);
+int RunLocalityReport(int gamesPerLength, string guesserName);
+int RunSnapshotBenchmark(int gamesPerLength, string guesserName);
+unsigned int PlayCandidateGuess(WordBucket& wordBucket, CandidateBits& candidateBits, HangmanGame& game, char guessChar, PartitionScratch& partitionScratch);
+int RunOpeningBookCheck();
+int RunSampledFamilyReport();
+int RunSimulation(int gamesPerLength, string guesserName, int threadCount, int guesses);
+void* ReplayWorkerMain(void* workerPointer);
+int RunReplay(string logFileName, int threadCount, vector<string>& dictionaryFileNames);
+int RunLookaheadBenchmark(int gamesPerLength, int maxDepth, string guesserName);
+long GetResidentKilobytes();
+int RunMemoryReport(int sessionCount);
+#ifdef COUNT_ALLOCATIONS
+int RunAllocationCheck();
+#endif
+
+/* Guessers available to the headless simulation */
+const Guesser GUESSERS[] = {
+    {"frequency", GuessByLetterFrequency},
+    {"random", GuessAtRandom},
+    {"entropy", GuessByEntropy}
+};
+
+#ifdef HAVE_PERF_EVENTS
+/* Cache events counted by the -locality report */
+const CacheEvent CACHE_EVENTS[] = {
+    {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"L1d-read-misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+    {"LLC-read-misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16}
+};
+#endif
+
+/* Functions */
+
+/*
+ * RunLoadTest
+ * Simulates clientCount clients against a running server, each playing
+ * gamesPerClient games over its own connection.  Clients cycle through word
+ * lengths 4 to 12 and guess letters in order of English frequency.  Prints
+ * turns per second and the median, p99 and worst turn latency seen by the
+ * clients.
+ */
+int RunLoadTest(string address, int clientCount, int gamesPerClient) {
+    vector<int> connections(clientCount);
+    vector<int> gamesLeft(clientCount, gamesPerClient);
+    vector<int> guessesMade(clientCount, 0);
+    vector<string> responses(clientCount);
+    vector<double> sentTimes(clientCount);
+    vector<double> turnLatencies;
+    char readBuffer[SERVER_READ_SIZE];
+    signal(SIGPIPE, SIG_IGN);
+    
+    double startTime = GetMicroseconds();
+    double now;
+    for (int client = 0; client < clientCount; client++) {
+        connections[client] = ConnectToServer(address);
+        if (connections[client] < 0) {
+            cout << "Could not connect client " << client << " to " << address << endl;
+            return 1;
+        }
+        stringstream command;
+        command << "NEW " << 4 + client % 9 << " " << LOAD_TEST_GUESSES << "\n";
+        write(connections[client], command.str().data(), command.str().size());
+        sentTimes[client] = GetMicroseconds();
+    }
+    
+    int clientsPlaying = clientCount;
+    vector<pollfd> pollSockets(clientCount);
+    while (clientsPlaying > 0) {
+        for (int client = 0; client < clientCount; client++) {
+            pollSockets[client].fd = gamesLeft[client] > 0 ? connections[client] : -1;
+            pollSockets[client].events = POLLIN;
+            pollSockets[client].revents = 0;
+        }
+        if (poll(&pollSockets[0], clientCount, -1) < 0) continue;
+        
+        for (int client = 0; client < clientCount; client++) {
+            if (!(pollSockets[client].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t bytesRead = read(connections[client], readBuffer, sizeof(readBuffer));
+            if (bytesRead <= 0) {
+                cout << "Server closed client " << client << endl;
+                return 1;
+            }
+            responses[client].append(readBuffer, bytesRead);
+            size_t lineEnd = responses[client].find('\n');
+            if (lineEnd == string::npos) continue;
+            string response = responses[client].substr(0, lineEnd);
+            responses[client].erase(0, lineEnd + 1);
+            
+            now = GetMicroseconds();
+            turnLatencies.push_back(now - sentTimes[client]);
+            
+            stringstream command;
+            if (response.compare(0, 4, "PLAY") == 0) {
+                command << "GUESS " << LETTER_FREQUENCY_ORDER[guessesMade[client]++] << "\n";
+            } else {
+                if (response.compare(0, 3, "ERR") == 0) cout << "Client " << client << ": " << response << endl;
+                guessesMade[client] = 0;
+                if (--gamesLeft[client] == 0) {
+                    clientsPlaying--;
+                    continue;
+                }
+                command << "NEW " << 4 + (client + gamesLeft[client]) % 9 << " " << LOAD_TEST_GUESSES << "\n";
+            }
+            write(connections[client], command.str().data(), command.str().size());
+            sentTimes[client] = now;
+        }
+    }
+    now = GetMicroseconds();
+    for (int client = 0; client < clientCount; client++) {
+        close(connections[client]);
+    }
+    
+    double elapsedSeconds = (now - startTime) * 1e-6;
+    sort(turnLatencies.begin(), turnLatencies.end());
+    cout << clientCount << " clients played " << clientCount * gamesPerClient << " games (" << turnLatencies.size() << " requests) in " << elapsedSeconds << " s" << endl;
+    cout << "Requests per second: " << turnLatencies.size() / elapsedSeconds << endl;
+    cout << "Median latency: " << turnLatencies[turnLatencies.size() / 2] << " us" << endl;
+    cout << "p99 latency: " << turnLatencies[turnLatencies.size() * 99 / 100] << " us" << endl;
+    cout << "Max latency: " << turnLatencies.back() << " us" << endl;
+    return 0;
+}
+
+/*
+ * RunPartitionScaling
+ * Benchmarks the opening partition (guess 'e' on the full bucket) of every
+ * word length with 1 to maxThreads threads and prints the mean time of
+ * SCALING_BENCHMARK_RUNS runs in milliseconds along with the speedup over
+ * one thread.
+ */
+int RunPartitionScaling(int maxThreads) {
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    
+    cout << "length words";
+    for (int threadCount = 1; threadCount <= maxThreads; threadCount++) {
+        cout << "  " << threadCount << "T ms (speedup)";
+    }
+    cout << endl;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        if (wordBuckets[wordLength].wordCount == 0) continue;
+        cout << wordLength << " " << wordBuckets[wordLength].wordCount;
+        double serialMilliseconds = 0;
+        for (int threadCount = 1; threadCount <= maxThreads; threadCount++) {
+            double totalMilliseconds = 0;
+            PartitionScratch partitionScratch;
+            for (int run = 0; run < SCALING_BENCHMARK_RUNS; run++) {
+                vector<int> possibleWords;
+                InitializePossibleWordIndices(wordBuckets[wordLength], possibleWords);
+                double startTime = GetMicroseconds();
+                if (threadCount == 1) {
+                    partitionThreadCount = 1;
+                    FindLargestWordFamily('e', wordBuckets[wordLength], possibleWords, partitionScratch);
+                } else {
+                    FindLargestWordFamilyInParallel('e', wordBuckets[wordLength], possibleWords, partitionScratch, threadCount, 0);
+                }
+                totalMilliseconds += (GetMicroseconds() - startTime) * 1e-3;
+            }
+            double meanMilliseconds = totalMilliseconds / SCALING_BENCHMARK_RUNS;
+            if (threadCount == 1) serialMilliseconds = meanMilliseconds;
+            cout << "  " << meanMilliseconds << " (" << (meanMilliseconds > 0 ? serialMilliseconds / meanMilliseconds : 1) << "x)";
+        }
+        cout << endl;
+    }
+    return 0;
+}
+
+/*
+ * GuessByLetterFrequency
+ * Guesser that picks the unguessed letter found in the most remaining words.
+ */
+char GuessByLetterFrequency(WordBucket& wordBucket, HangmanGame& game, PartitionScratch& /* guesserScratch */, unsigned int& /* randomSeed */) {
+    int letterCounts[26] = {0};
+    for (size_t i = 0; i < game.possibleWords.size(); i++) {
+        const char* word = GetBucketWord(wordBucket, game.possibleWords[i]);
+        unsigned int lettersPresent = 0;
+        for (int j = 0; j < wordBucket.wordLength; j++) {
+            if (word[j] >= 'a' && word[j] <= 'z') lettersPresent |= 1u << (word[j] - 'a');
+        }
+        for (int letter = 0; letter < 26; letter++) {
+            if (lettersPresent & (1u << letter)) letterCounts[letter]++;
+        }
+    }
+    char bestLetter = 0;
+    for (int letter = 0; letter < 26; letter++) {
+        if (game.charactersGuessed.find(ALPHABET[letter]) != string::npos) continue;
+        if (bestLetter == 0 || letterCounts[letter] > letterCounts[bestLetter - 'a']) bestLetter = ALPHABET[letter];
+    }
+    return bestLetter;
+}
+
+/*
+ * GuessAtRandom
+ * Guesser that picks any unguessed letter with equal probability.
+ */
+char GuessAtRandom(WordBucket& /* wordBucket */, HangmanGame& game, PartitionScratch& /* guesserScratch */, unsigned int& randomSeed) {
+    int lettersLeft = (int)(ALPHABET.size() - game.charactersGuessed.size());
+    int choice = rand_r(&randomSeed) % lettersLeft;
+    for (size_t letter = 0; letter < ALPHABET.size(); letter++) {
+        if (game.charactersGuessed.find(ALPHABET[letter]) != string::npos) continue;
+        if (choice-- == 0) return ALPHABET[letter];
+    }
+    return 0;
+}
+
+/*
+ * GuessByEntropy
+ * Guesser that picks the unguessed letter whose family partition of the
+ * remaining words has the highest entropy, i.e. the letter expected to tell
+ * the player the most about the word.  Ties (such as a single remaining word)
+ * go to the letter found in the most words.
+ */
+char GuessByEntropy(WordBucket& wordBucket, HangmanGame& game, PartitionScratch& guesserScratch, unsigned int& /* randomSeed */) {
+    char bestLetter = 0;
+    double bestEntropy = -1;
+    int bestMisses = 0;
+    double poolSize = (double)game.possibleWords.size();
+    for (size_t letter = 0; letter < ALPHABET.size(); letter++) {
+        if (game.charactersGuessed.find(ALPHABET[letter]) != string::npos) continue;
+        ReservePartitionScratch(guesserScratch, game.possibleWords.size());
+        unsigned int* familyKeys = (unsigned int*)AllocateScratch(guesserScratch.arena, game.possibleWords.size() * sizeof(unsigned int));
+        MakeWordFamilyKeys(wordBucket, game.possibleWords, ALPHABET[letter], familyKeys);
+        FamilyTable& familyTable = guesserScratch.familyTable;
+        InitializeFamilyTable(familyTable, game.possibleWords.size(), guesserScratch.arena);
+        for (size_t i = 0; i < game.possibleWords.size(); i++) {
+            AddToFamilyTable(familyTable, familyKeys[i], 1);
+        }
+        double entropy = 0;
+        int misses = 0;
+        for (size_t slot = 0; slot < familyTable.slotCount; slot++) {
+            if (familyTable.counts[slot] == 0) continue;
+            double probability = familyTable.counts[slot] / poolSize;
+            entropy -= probability * log(probability);
+            if (familyTable.keys[slot] == 0) misses = familyTable.counts[slot];
+        }
+        if (entropy > bestEntropy + 1e-12 || (entropy > bestEntropy - 1e-12 && misses < bestMisses)) {
+            bestEntropy = entropy;
+            bestMisses = misses;
+            bestLetter = ALPHABET[letter];
+        }
+    }
+    return bestLetter;
+}
+
+/*
+ * FindGuesser
+ * Takes in a guesser name and a guesser by reference and sets the guesser to
+ * the one of that name in GUESSERS, returning false if there is none.
+ */
+bool FindGuesser(string guesserName, Guesser& guesser) {
+    for (size_t i = 0; i < sizeof(GUESSERS) / sizeof(GUESSERS[0]); i++) {
+        if (guesserName == GUESSERS[i].name) {
+            guesser = GUESSERS[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * GetLatencyBucket
+ * Returns the turn latency histogram bucket for a latency in microseconds.
+ * Bucket k counts latencies of at most FIRST_LATENCY_BUCKET * 2^k, and the
+ * last bucket also counts everything slower.
+ */
+int GetLatencyBucket(double latencyMicroseconds) {
+    int bucket = 0;
+    double bucketLimit = FIRST_LATENCY_BUCKET;
+    while (latencyMicroseconds > bucketLimit && bucket < LATENCY_BUCKETS - 1) {
+        bucketLimit *= 2;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * GetLatencyPercentile
+ * Returns the upper limit in microseconds of the histogram bucket holding the
+ * given percentile of the counted latencies.
+ */
+double GetLatencyPercentile(vector<long>& latencyHistogram, double percentile) {
+    long total = 0;
+    for (size_t bucket = 0; bucket < latencyHistogram.size(); bucket++) total += latencyHistogram[bucket];
+    long seen = 0;
+    double bucketLimit = FIRST_LATENCY_BUCKET;
+    for (size_t bucket = 0; bucket < latencyHistogram.size(); bucket++) {
+        seen += latencyHistogram[bucket];
+        if (seen >= total * percentile / 100) return bucketLimit;
+        bucketLimit *= 2;
+    }
+    return bucketLimit;
+}
+
+/*
+ * SimulationWorkerMain
+ * The body of each simulation thread.  Plays the worker's share of games with
+ * its guesser, which shares the thread's partition scratch space, timing every PlayHangmanGuess (the guesser's own thinking is
+ * not counted) into the worker's latency histogram.  Games are recorded if
+ * a replay log is open.
+ */
+void* SimulationWorkerMain(void* workerPointer) {
+    SimulationWorker& worker = *(SimulationWorker*)workerPointer;
+    WordBucket& wordBucket = (*worker.wordBuckets)[worker.wordLength];
+    HangmanGame game;
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, wordBucket.wordCount);
+    ReplayRecord replayRecord;
+    for (int gameNumber = 0; gameNumber < worker.games; gameNumber++) {
+        StartHangmanGame(*worker.wordBuckets, worker.wordLength, worker.guesses, game);
+        StartReplayRecord(replayRecord, worker.dictionaryChecksum, worker.wordLength, worker.guesses);
+        while (game.guessesRemaining > 0 && !IsWordGuessed(game.guessedWord)) {
+            char guessChar = worker.guesser.guessLetter(wordBucket, game, partitionScratch, worker.randomSeed);
+            double startTime = GetMicroseconds();
+            unsigned int familyKey = PlayHangmanGuess(*worker.wordBuckets, game, guessChar, partitionScratch, worker.partitionCache, 0);
+            worker.latencyHistogram[GetLatencyBucket(GetMicroseconds() - startTime)]++;
+            worker.turns++;
+            AddReplayTurn(replayRecord, guessChar, familyKey, game.possibleWords.size());
+        }
+        WriteReplayRecord(replayRecord);
+        if (IsWordGuessed(game.guessedWord)) worker.wins++;
+    }
+    return NULL;
+}
+
+/*
+ * RunSimulation
+ * Plays gamesPerLength games of every word length without any prompting,
+ * with the named guesser (or every guesser for "all"), split across
+ * threadCount threads.  Prints games and turns per second, win rate and
+ * turn latency percentiles per length, then each guesser's turn latency
+ * histogram.
+ */
+int RunSimulation(int gamesPerLength, string guesserName, int threadCount, int guesses) {
+    vector<Guesser> guessers;
+    Guesser guesser;
+    if (guesserName == "all") {
+        guessers.assign(GUESSERS, GUESSERS + sizeof(GUESSERS) / sizeof(GUESSERS[0]));
+    } else if (FindGuesser(guesserName, guesser)) {
+        guessers.push_back(guesser);
+    } else {
+        cout << "Unknown guesser " << guesserName << endl;
+        return 1;
+    }
+    if (threadCount < 1 || gamesPerLength < 1 || guesses < 1) return 1;
+    
+    /* Games run in parallel, so each turn is partitioned on its own thread */
+    if (threadCount > 1) partitionThreadCount = 1;
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    uint64_t dictionaryChecksum = replayLog.file >= 0 ? GetDictionaryChecksum(compiledDictionary) : 0;
+    
+    for (size_t guesserIndex = 0; guesserIndex < guessers.size(); guesserIndex++) {
+        /* Each guesser gets a fresh cache so its hit rate is its own */
+        PartitionCache partitionCache;
+        if (partitionCacheWords > 0) {
+            InitializePartitionCache(partitionCache, partitionCacheWords);
+            PrewarmPartitionCache(wordBuckets, partitionCache, partitionCachePrewarm);
+        }
+        cout << "Guesser " << guessers[guesserIndex].name << ", " << guesses << " guesses, " << threadCount << " threads" << endl;
+        cout << "length words games/s turns/s win% p50us p99us" << endl;
+        vector<long> latencyHistogram(LATENCY_BUCKETS, 0);
+        for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+            if (wordBuckets[wordLength].wordCount == 0) continue;
+            vector<SimulationWorker> workers(threadCount);
+            vector<pthread_t> threads(threadCount);
+            double startTime = GetMicroseconds();
+            for (int i = 0; i < threadCount; i++) {
+                workers[i].wordBuckets = &wordBuckets;
+                workers[i].partitionCache = partitionCacheWords > 0 ? &partitionCache : NULL;
+                workers[i].dictionaryChecksum = dictionaryChecksum;
+                workers[i].guesser = guessers[guesserIndex];
+                workers[i].wordLength = wordLength;
+                workers[i].games = gamesPerLength * (i + 1) / threadCount - gamesPerLength * i / threadCount;
+                workers[i].guesses = guesses;
+                workers[i].randomSeed = SIMULATION_RANDOM_SEED + wordLength * threadCount + i;
+                workers[i].wins = 0;
+                workers[i].turns = 0;
+                workers[i].latencyHistogram.assign(LATENCY_BUCKETS, 0);
+                pthread_create(&threads[i], NULL, SimulationWorkerMain, &workers[i]);
+            }
+            long wins = 0, turns = 0;
+            vector<long> lengthHistogram(LATENCY_BUCKETS, 0);
+            for (int i = 0; i < threadCount; i++) {
+                pthread_join(threads[i], NULL);
+                wins += workers[i].wins;
+                turns += workers[i].turns;
+                for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+                    lengthHistogram[bucket] += workers[i].latencyHistogram[bucket];
+                    latencyHistogram[bucket] += workers[i].latencyHistogram[bucket];
+                }
+            }
+            double elapsedSeconds = (GetMicroseconds() - startTime) * 1e-6;
+            cout << wordLength << " " << wordBuckets[wordLength].wordCount << " "
+                 << gamesPerLength / elapsedSeconds << " " << turns / elapsedSeconds << " "
+                 << 100.0 * wins / gamesPerLength << " "
+                 << GetLatencyPercentile(lengthHistogram, 50) << " " << GetLatencyPercentile(lengthHistogram, 99) << endl;
+        }
+        cout << "Turn latency histogram for " << guessers[guesserIndex].name << ":" << endl;
+        double bucketLimit = FIRST_LATENCY_BUCKET;
+        for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            if (latencyHistogram[bucket] > 0) {
+                cout << "  <= " << bucketLimit << " us: " << latencyHistogram[bucket] << endl;
+            }
+            bucketLimit *= 2;
+        }
+        if (partitionCacheWords > 0) {
+            cout << "Partition cache hits, misses, entries, words: " << DescribePartitionCache(partitionCache) << endl;
+        }
+    }
+    return 0;
+}
+
+/*
+ * ReplayWorkerMain
+ * The body of each replay thread.  Replays batches of logged games until the
+ * log runs out, timing every PlayHangmanGuess into the worker's turn
+ * latencies.  A game stops being replayed at the first turn that reveals a
+ * different pattern or leaves a different number of words than recorded.
+ */
+void* ReplayWorkerMain(void* workerPointer) {
+    ReplayWorker& worker = *(ReplayWorker*)workerPointer;
+    vector<size_t>& recordOffsets = *worker.recordOffsets;
+    long recordCount = (long)recordOffsets.size() - 1;
+    size_t largestBucketSize = 0;
+    for (size_t i = 0; i < worker.dictionaries->size(); i++) {
+        largestBucketSize = max(largestBucketSize, GetLargestWordBucketSize((*worker.dictionaries)[i]->wordBuckets));
+    }
+    HangmanGame game;
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, largestBucketSize);
+    string pattern;
+    
+    long firstRecord;
+    while ((firstRecord = __sync_fetch_and_add(worker.nextRecord, REPLAY_BATCH_GAMES)) < recordCount) {
+        long lastRecord = min(firstRecord + REPLAY_BATCH_GAMES, recordCount);
+        for (long record = firstRecord; record < lastRecord; record++) {
+            const unsigned char* position = (const unsigned char*)worker.logData + recordOffsets[record];
+            const unsigned char* end = (const unsigned char*)worker.logData + recordOffsets[record + 1];
+            ReplayRecordHeader header;
+            memcpy(&header, position, sizeof(header));
+            position += sizeof(header);
+            LoadedDictionary* dictionary = NULL;
+            for (size_t i = 0; i < worker.dictionaries->size() && dictionary == NULL; i++) {
+                if ((*worker.dictionaries)[i]->checksum == header.dictionaryChecksum) dictionary = (*worker.dictionaries)[i];
+            }
+            if (dictionary == NULL) {
+                worker.skipped++;
+                continue;
+            }
+            PartitionCache* partitionCache = partitionCacheWords > 0 ? &dictionary->partitionCache : NULL;
+            bool matched = StartHangmanGame(dictionary->wordBuckets, header.wordLength, header.guesses, game);
+            InitializeGuessedWord(header.wordLength, pattern);
+            int turn = 0;
+            uint32_t familyKey = 0, poolWordCount = 0;
+            while (matched && turn < header.guessCount) {
+                char guessChar = *position++;
+                ReadSnapshotGap(position, end, familyKey);
+                ReadSnapshotGap(position, end, poolWordCount);
+                turn++;
+                if (game.guessesRemaining == 0 || IsWordGuessed(game.guessedWord)) {
+                    matched = false;
+                    break;
+                }
+                double startTime = GetMicroseconds();
+                PlayHangmanGuess(dictionary->wordBuckets, game, guessChar, partitionScratch, partitionCache, 0);
+                worker.turnLatencies.push_back((float)(GetMicroseconds() - startTime));
+                worker.turns++;
+                SetPatternLetter(pattern, familyKey, guessChar);
+                matched = game.guessedWord == pattern && game.possibleWords.size() == poolWordCount;
+            }
+            if (!matched && worker.mismatches++ == 0) {
+                stringstream mismatch;
+                mismatch << "game " << record << " turn " << turn << ": " << game.guessedWord << " with "
+                         << game.possibleWords.size() << " words left, recorded " << pattern << " with "
+                         << poolWordCount << " words left";
+                worker.firstMismatch = mismatch.str();
+            }
+            worker.games++;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * RunReplay
+ * Replays every game of a replay log on threadCount threads, on whichever of
+ * the given dictionary files (by default the one games are played on) each
+ * was recorded on, and checks every turn against its record.  Prints the
+ * games and turns replayed, the games that went differently (and the first
+ * of them), the games skipped for want of their dictionary, games and turns
+ * per second and turn latency percentiles, one figure a line so that the
+ * output of two builds can be diffed.  Returns 1 if the log is malformed or
+ * any game went differently.
+ */
+int RunReplay(string logFileName, int threadCount, vector<string>& dictionaryFileNames) {
+    if (threadCount < 1) return 1;
+    int fileDescriptor = open(logFileName.c_str(), O_RDONLY);
+    struct stat fileStatus;
+    if (fileDescriptor < 0 || fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size == 0) {
+        cout << "Could not read replay log " << logFileName << endl;
+        if (fileDescriptor >= 0) close(fileDescriptor);
+        return 1;
+    }
+    size_t logSize = fileStatus.st_size;
+    void* mapping = mmap(NULL, logSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (mapping == MAP_FAILED) {
+        cout << "Could not map replay log " << logFileName << endl;
+        return 1;
+    }
+    const char* logData = (const char*)mapping;
+    
+    /* Index the records, checking them on the way */
+    vector<size_t> recordOffsets;
+    const unsigned char* position = (const unsigned char*)logData;
+    const unsigned char* end = position + logSize;
+    while (position < end) {
+        recordOffsets.push_back(position - (const unsigned char*)logData);
+        ReplayRecordHeader header;
+        if (!ReadReplayRecord(position, end, header)) {
+            cout << "Malformed replay record at byte " << recordOffsets.back() << " of " << logFileName << endl;
+            munmap(mapping, logSize);
+            return 1;
+        }
+    }
+    recordOffsets.push_back(logSize);
+    
+    /* Games run in parallel, so each turn is partitioned on its own thread */
+    if (threadCount > 1) partitionThreadCount = 1;
+    if (dictionaryFileNames.empty()) dictionaryFileNames.push_back(GetDefaultDictionaryFileName());
+    vector<LoadedDictionary*> dictionaries;
+    for (size_t i = 0; i < dictionaryFileNames.size(); i++) {
+        LoadedDictionary* dictionary = LoadServedDictionary(dictionaryFileNames[i]);
+        if (dictionary == NULL) {
+            cout << "Could not load " << dictionaryFileNames[i] << endl;
+            return 1;
+        }
+        dictionaries.push_back(dictionary);
+    }
+    
+    volatile long nextRecord = 0;
+    vector<ReplayWorker> workers(threadCount);
+    vector<pthread_t> threads(threadCount);
+    double startTime = GetMicroseconds();
+    for (int i = 0; i < threadCount; i++) {
+        workers[i].logData = logData;
+        workers[i].recordOffsets = &recordOffsets;
+        workers[i].nextRecord = &nextRecord;
+        workers[i].dictionaries = &dictionaries;
+        workers[i].games = 0;
+        workers[i].turns = 0;
+        workers[i].mismatches = 0;
+        workers[i].skipped = 0;
+        pthread_create(&threads[i], NULL, ReplayWorkerMain, &workers[i]);
+    }
+    long games = 0, turns = 0, mismatches = 0, skipped = 0;
+    string firstMismatch;
+    vector<float> turnLatencies;
+    for (int i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+        games += workers[i].games;
+        turns += workers[i].turns;
+        mismatches += workers[i].mismatches;
+        skipped += workers[i].skipped;
+        if (firstMismatch.empty()) firstMismatch = workers[i].firstMismatch;
+    }
+    double elapsedSeconds = (GetMicroseconds() - startTime) * 1e-6;
+    for (int i = 0; i < threadCount; i++) {
+        turnLatencies.insert(turnLatencies.end(), workers[i].turnLatencies.begin(), workers[i].turnLatencies.end());
+        vector<float>().swap(workers[i].turnLatencies);
+    }
+    sort(turnLatencies.begin(), turnLatencies.end());
+    
+    cout << "Replayed " << games << " games (" << turns << " turns) from " << logFileName << " on "
+         << threadCount << " threads in " << elapsedSeconds << " s" << endl;
+    cout << "Games that went differently: " << mismatches << endl;
+    if (mismatches > 0) cout << "First difference: " << firstMismatch << endl;
+    cout << "Games skipped for want of their dictionary: " << skipped << endl;
+    cout << "Games per second: " << (elapsedSeconds > 0 ? games / elapsedSeconds : 0) << endl;
+    cout << "Turns per second: " << (elapsedSeconds > 0 ? turns / elapsedSeconds : 0) << endl;
+    if (!turnLatencies.empty()) {
+        const double percentiles[] = {50, 90, 99, 99.9};
+        for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+            cout << "p" << percentiles[i] << " turn latency: "
+                 << turnLatencies[(size_t)(turnLatencies.size() * percentiles[i] / 100)] << " us" << endl;
+        }
+        cout << "Max turn latency: " << turnLatencies.back() << " us" << endl;
+    }
+    
+    for (size_t i = 0; i < dictionaries.size(); i++) {
+        FreeLoadedDictionary(dictionaries[i]);
+    }
+    munmap(mapping, logSize);
+    return mismatches > 0 ? 1 : 0;
+}
+
+/*
+ * RunLookaheadBenchmark
+ * Plays gamesPerLength games of every word length with the named guesser and
+ * SIMULATION_GUESSES guesses, first with the greedy strategy and then
+ * with the lookahead strategy searching each depth from 0 to maxDepth, and
+ * prints turn latency percentiles, the mean depth the lookahead finished
+ * within lookaheadBudget, the misses forced per game and the win rate for
+ * each.  The partition cache is left out so every turn is searched.
+ */
+int RunLookaheadBenchmark(int gamesPerLength, int maxDepth, string guesserName) {
+    Guesser guesser;
+    if (!FindGuesser(guesserName, guesser)) {
+        cout << "Unknown guesser " << guesserName << endl;
+        return 1;
+    }
+    if (gamesPerLength < 1 || maxDepth < 0) return 1;
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, GetLargestWordBucketSize(wordBuckets));
+    int savedDepth = lookaheadDepth;
+    
+    cout << "Lookahead budget " << lookaheadBudget << " us, " << partitionThreadCount << " threads" << endl;
+    cout << "strategy depth turns p50us p99us maxus reached misses/game win%" << endl;
+    for (int depth = -1; depth <= maxDepth; depth++) {
+        familyStrategy = FAMILY_STRATEGIES[depth < 0 ? 0 : 1];
+        lookaheadDepth = max(depth, 0);
+        vector<long> latencyHistogram(LATENCY_BUCKETS, 0);
+        long turns = 0, games = 0, wins = 0, misses = 0, depthReached = 0;
+        double maxMicroseconds = 0;
+        unsigned int randomSeed = SIMULATION_RANDOM_SEED;
+        HangmanGame game;
+        for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+            if (wordBuckets[wordLength].wordCount == 0) continue;
+            for (int gameNumber = 0; gameNumber < gamesPerLength; gameNumber++) {
+                StartHangmanGame(wordBuckets, wordLength, SIMULATION_GUESSES, game);
+                while (game.guessesRemaining > 0 && !IsWordGuessed(game.guessedWord)) {
+                    char guessChar = guesser.guessLetter(wordBuckets[wordLength], game, partitionScratch, randomSeed);
+                    double startTime = GetMicroseconds();
+                    PlayHangmanGuess(wordBuckets, game, guessChar, partitionScratch, NULL, 0);
+                    double latencyMicroseconds = GetMicroseconds() - startTime;
+                    latencyHistogram[GetLatencyBucket(latencyMicroseconds)]++;
+                    maxMicroseconds = max(maxMicroseconds, latencyMicroseconds);
+                    if (depth >= 0) depthReached += partitionScratch.lookaheadSearch.completedDepth;
+                    turns++;
+                }
+                misses += SIMULATION_GUESSES - game.guessesRemaining;
+                if (IsWordGuessed(game.guessedWord)) wins++;
+                games++;
+            }
+        }
+        if (depth < 0) {
+            cout << familyStrategy.name << " -";
+        } else {
+            cout << familyStrategy.name << " " << depth;
+        }
+        cout << " " << turns << " "
+             << GetLatencyPercentile(latencyHistogram, 50) << " " << GetLatencyPercentile(latencyHistogram, 99) << " "
+             << maxMicroseconds << " " << (depth < 0 ? 0.0 : (double)depthReached / turns) << " "
+             << (double)misses / games << " " << 100.0 * wins / games << endl;
+    }
+    familyStrategy = FAMILY_STRATEGIES[0];
+    lookaheadDepth = savedDepth;
+    return 0;
+}
+
+/*
+ * RunCandidateBitsBenchmark
+ * Plays gamesPerLength games of every word length with the named guesser and
+ * SIMULATION_GUESSES guesses, partitioning each turn both as a list with
+ * FindLargestWordFamily and as CandidateBits with FindLargestFamilyInBits on
+ * one thread, and prints the mean turn time and the size of the pool for
+ * each.  Each turn is also played on a second CandidateBits with the opening
+ * book, through ChooseLargestFamilyInBits, and the turns the book answers are
+ * counted.  Returns 1 if any of them ever pick different families.
+ */
+int RunCandidateBitsBenchmark(int gamesPerLength, string guesserName) {
+    Guesser guesser;
+    if (!FindGuesser(guesserName, guesser)) {
+        cout << "Unknown guesser " << guesserName << endl;
+        return 1;
+    }
+    if (gamesPerLength < 1) return 1;
+    partitionThreadCount = 1;
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    PartitionScratch listScratch, bitsScratch;
+    ReservePartitionScratch(listScratch, GetLargestWordBucketSize(wordBuckets));
+    
+    long mismatches = 0;
+    unsigned int randomSeed = SIMULATION_RANDOM_SEED;
+    HangmanGame game;
+    CandidateBits candidateBits, bookBits;
+    cout << "Guesser " << guesser.name << ", " << SIMULATION_GUESSES << " guesses" << endl;
+    cout << "length words turns bookturns listus bitsus speedup listKB bitsKB" << endl;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        WordBucket& wordBucket = wordBuckets[wordLength];
+        if (wordBucket.wordCount == 0) continue;
+        long turns = 0, bookTurns = 0;
+        double listMicroseconds = 0, bitsMicroseconds = 0;
+        for (int gameNumber = 0; gameNumber < gamesPerLength; gameNumber++) {
+            StartHangmanGame(wordBuckets, wordLength, SIMULATION_GUESSES, game);
+            InitializeCandidateBits(wordBucket, candidateBits);
+            InitializeCandidateBits(wordBucket, bookBits);
+            while (game.guessesRemaining > 0 && !IsWordGuessed(game.guessedWord)) {
+                char guessChar = guesser.guessLetter(wordBucket, game, listScratch, randomSeed);
+                double startTime = GetMicroseconds();
+                unsigned int familyKey = FindLargestWordFamily(guessChar, wordBucket, game.possibleWords, listScratch);
+                double listTime = GetMicroseconds();
+                unsigned int bitsFamilyKey = FindLargestFamilyInBits(guessChar, wordBucket, candidateBits, bitsScratch);
+                bitsMicroseconds += GetMicroseconds() - listTime;
+                listMicroseconds += listTime - startTime;
+                if (bitsFamilyKey != familyKey || (size_t)candidateBits.wordCount != game.possibleWords.size()) mismatches++;
+                if (FindOpeningBookEntry(wordBucket, bookBits.wordCount, game.guessedWord, game.charactersGuessed, guessChar) != NULL) bookTurns++;
+                unsigned int bookFamilyKey = ChooseLargestFamilyInBits(guessChar, wordBucket, bookBits, game.guessedWord, game.charactersGuessed, bitsScratch);
+                if (bookFamilyKey != familyKey || bookBits.wordCount != candidateBits.wordCount) mismatches++;
+                if (familyKey == 0) game.guessesRemaining--;
+                UpdateGuessedWordAndCharactersGuessed(familyKey, game.guessedWord, game.charactersGuessed, guessChar);
+                turns++;
+            }
+        }
+        cout << wordLength << " " << wordBucket.wordCount << " " << turns << " " << bookTurns << " "
+             << listMicroseconds / turns << " " << bitsMicroseconds / turns << " "
+             << (bitsMicroseconds > 0 ? listMicroseconds / bitsMicroseconds : 0) << " "
+             << wordBucket.wordCount * sizeof(int) / 1024.0 << " " << wordBucket.blockCount * sizeof(uint64_t) / 1024.0 << endl;
+    }
+    cout << (mismatches == 0 ? "PASS" : "FAIL") << ": " << mismatches << " turns with different families" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+/*
+ * OpenCacheCounters, StartCacheCounters, StopCacheCounters, ReadCacheCounter,
+ * CloseCacheCounters
+ * Open a disabled counter for every event in CACHE_EVENTS, count while
+ * started, read one event's total (false if it could not be counted) and
+ * close them all.
+ */
+void OpenCacheCounters(CacheCounters& cacheCounters) {
+    cacheCounters.files.clear();
+#ifdef HAVE_PERF_EVENTS
+    for (size_t i = 0; i < sizeof(CACHE_EVENTS) / sizeof(CACHE_EVENTS[0]); i++) {
+        struct perf_event_attr eventAttributes;
+        memset(&eventAttributes, 0, sizeof(eventAttributes));
+        eventAttributes.size = sizeof(eventAttributes);
+        eventAttributes.type = CACHE_EVENTS[i].type;
+        eventAttributes.config = CACHE_EVENTS[i].config;
+        eventAttributes.disabled = 1;
+        eventAttributes.exclude_kernel = 1;
+        eventAttributes.exclude_hv = 1;
+        cacheCounters.files.push_back((int)syscall(SYS_perf_event_open, &eventAttributes, 0, -1, -1, 0));
+    }
+#endif
+}
+
+void StartCacheCounters(CacheCounters& cacheCounters) {
+#ifdef HAVE_PERF_EVENTS
+    for (size_t i = 0; i < cacheCounters.files.size(); i++) {
+        if (cacheCounters.files[i] >= 0) ioctl(cacheCounters.files[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+void StopCacheCounters(CacheCounters& cacheCounters) {
+#ifdef HAVE_PERF_EVENTS
+    for (size_t i = 0; i < cacheCounters.files.size(); i++) {
+        if (cacheCounters.files[i] >= 0) ioctl(cacheCounters.files[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+}
+
+bool ReadCacheCounter(CacheCounters& cacheCounters, size_t event, uint64_t& count) {
+    if (event >= cacheCounters.files.size() || cacheCounters.files[event] < 0) return false;
+    return read(cacheCounters.files[event], &count, sizeof(count)) == (ssize_t)sizeof(count);
+}
+
+void CloseCacheCounters(CacheCounters& cacheCounters) {
+    for (size_t i = 0; i < cacheCounters.files.size(); i++) {
+        if (cacheCounters.files[i] >= 0) close(cacheCounters.files[i]);
+    }
+    cacheCounters.files.clear();
+}
+
+/*
+ * RunLocalityReport
+ * Lays the text dictionary out twice, once alphabetically and once in the
+ * order of the compiled dictionary (see DictionaryWordOrder), and plays
+ * gamesPerLength games of every word length with the named guesser and
+ * SIMULATION_GUESSES guesses on both at once, with no opening book and on one
+ * thread.  Each turn is partitioned as a list with FindLargestWordFamily and
+ * as CandidateBits with FindLargestFamilyInBits in each layout.  Prints the
+ * mean turn time of each by word length, then the CACHE_EVENTS counted per
+ * turn over all lengths.  Returns 1 if the layouts or the pool kinds ever
+ * pick different families or leave pools of different sizes.
+ */
+int RunLocalityReport(int gamesPerLength, string guesserName) {
+    Guesser guesser;
+    if (!FindGuesser(guesserName, guesser)) {
+        cout << "Unknown guesser " << guesserName << endl;
+        return 1;
+    }
+    if (gamesPerLength < 1) return 1;
+    partitionThreadCount = 1;
+    ifstream dictionaryFile;
+    string dictionaryText;
+    vector<DictionaryWord> dictionaryWords;
+    OpenFile(dictionaryFile, HANGMAN_DICTIONARY);
+    if (!dictionaryFile.is_open()) return 1;
+    ReadDictionary(dictionaryFile, dictionaryText, dictionaryWords);
+    
+    /* Layout 0 is alphabetical and layout 1 that of the compiled dictionary */
+    CompiledDictionary compiledDictionaries[2];
+    vector<WordBucket> wordBuckets[2];
+    LayOutCompiledDictionary(dictionaryText, dictionaryWords, compiledDictionaries[1].builtData);
+    DictionaryWordOrder alphabeticalOrder = {dictionaryText.data(), false};
+    sort(dictionaryWords.begin(), dictionaryWords.end(), alphabeticalOrder);
+    LayOutCompiledDictionary(dictionaryText, dictionaryWords, compiledDictionaries[0].builtData);
+    for (int layout = 0; layout < 2; layout++) {
+        CompiledDictionary& compiledDictionary = compiledDictionaries[layout];
+        compiledDictionary.fileData = compiledDictionary.builtData.data();
+        compiledDictionary.fileSize = compiledDictionary.builtData.size();
+        compiledDictionary.bookData = NULL;
+        compiledDictionary.bookSize = 0;
+        wordBuckets[layout].resize(MAX_WORD_LENGTH + 1);
+        for (int wordLength = 0; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+            FindCompiledWordBucket(compiledDictionary, wordLength, wordBuckets[layout][wordLength]);
+        }
+    }
+    PartitionScratch listScratch, bitsScratch;
+    ReservePartitionScratch(listScratch, GetLargestWordBucketSize(wordBuckets[0]));
+    CacheCounters listCounters[2], bitsCounters[2];
+    for (int layout = 0; layout < 2; layout++) {
+        OpenCacheCounters(listCounters[layout]);
+        OpenCacheCounters(bitsCounters[layout]);
+    }
+    
+    long mismatches = 0, allTurns = 0;
+    double allListMicroseconds[2] = {0, 0}, allBitsMicroseconds[2] = {0, 0};
+    unsigned int randomSeed = SIMULATION_RANDOM_SEED;
+    HangmanGame games[2];
+    CandidateBits candidateBits[2];
+    cout << "Guesser " << guesser.name << ", " << SIMULATION_GUESSES << " guesses, " << gamesPerLength << " games per length" << endl;
+    cout << "length words turns alphalistus listus listspeedup alphabitsus bitsus bitsspeedup" << endl;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        if (wordBuckets[0][wordLength].wordCount == 0) continue;
+        long turns = 0;
+        double listMicroseconds[2] = {0, 0}, bitsMicroseconds[2] = {0, 0};
+        for (int gameNumber = 0; gameNumber < gamesPerLength; gameNumber++) {
+            for (int layout = 0; layout < 2; layout++) {
+                StartHangmanGame(wordBuckets[layout], wordLength, SIMULATION_GUESSES, games[layout]);
+                InitializeCandidateBits(wordBuckets[layout][wordLength], candidateBits[layout]);
+            }
+            while (games[0].guessesRemaining > 0 && !IsWordGuessed(games[0].guessedWord)) {
+                char guessChar = guesser.guessLetter(wordBuckets[0][wordLength], games[0], listScratch, randomSeed);
+                unsigned int familyKeys[2];
+                for (int pass = 0; pass < 2; pass++) {
+                    /* Alternate which layout goes first, so neither always finds the other's lines in cache */
+                    int layout = (int)((pass + turns) % 2);
+                    WordBucket& wordBucket = wordBuckets[layout][wordLength];
+                    StartCacheCounters(listCounters[layout]);
+                    double startTime = GetMicroseconds();
+                    familyKeys[layout] = FindLargestWordFamily(guessChar, wordBucket, games[layout].possibleWords, listScratch);
+                    listMicroseconds[layout] += GetMicroseconds() - startTime;
+                    StopCacheCounters(listCounters[layout]);
+                    StartCacheCounters(bitsCounters[layout]);
+                    startTime = GetMicroseconds();
+                    unsigned int bitsFamilyKey = FindLargestFamilyInBits(guessChar, wordBucket, candidateBits[layout], bitsScratch);
+                    bitsMicroseconds[layout] += GetMicroseconds() - startTime;
+                    StopCacheCounters(bitsCounters[layout]);
+                    if (bitsFamilyKey != familyKeys[layout] || (size_t)candidateBits[layout].wordCount != games[layout].possibleWords.size()) mismatches++;
+                }
+                if (familyKeys[1] != familyKeys[0] || games[1].possibleWords.size() != games[0].possibleWords.size()) mismatches++;
+                for (int layout = 0; layout < 2; layout++) {
+                    if (familyKeys[layout] == 0) games[layout].guessesRemaining--;
+                    UpdateGuessedWordAndCharactersGuessed(familyKeys[layout], games[layout].guessedWord, games[layout].charactersGuessed, guessChar);
+                }
+                turns++;
+            }
+        }
+        cout << wordLength << " " << wordBuckets[0][wordLength].wordCount << " " << turns << " "
+             << listMicroseconds[0] / turns << " " << listMicroseconds[1] / turns << " "
+             << (listMicroseconds[1] > 0 ? listMicroseconds[0] / listMicroseconds[1] : 0) << " "
+             << bitsMicroseconds[0] / turns << " " << bitsMicroseconds[1] / turns << " "
+             << (bitsMicroseconds[1] > 0 ? bitsMicroseconds[0] / bitsMicroseconds[1] : 0) << endl;
+        allTurns += turns;
+        for (int layout = 0; layout < 2; layout++) {
+            allListMicroseconds[layout] += listMicroseconds[layout];
+            allBitsMicroseconds[layout] += bitsMicroseconds[layout];
+        }
+    }
+    if (allTurns == 0) return 1;
+    cout << "all " << dictionaryWords.size() << " " << allTurns << " "
+         << allListMicroseconds[0] / allTurns << " " << allListMicroseconds[1] / allTurns << " "
+         << (allListMicroseconds[1] > 0 ? allListMicroseconds[0] / allListMicroseconds[1] : 0) << " "
+         << allBitsMicroseconds[0] / allTurns << " " << allBitsMicroseconds[1] / allTurns << " "
+         << (allBitsMicroseconds[1] > 0 ? allBitsMicroseconds[0] / allBitsMicroseconds[1] : 0) << endl;
+    
+    cout << "event alphalist list alphabits bits (per turn)" << endl;
+#ifdef HAVE_PERF_EVENTS
+    for (size_t i = 0; i < sizeof(CACHE_EVENTS) / sizeof(CACHE_EVENTS[0]); i++) {
+        uint64_t counts[4];
+        bool counted = ReadCacheCounter(listCounters[0], i, counts[0]) && ReadCacheCounter(listCounters[1], i, counts[1]) &&
+                       ReadCacheCounter(bitsCounters[0], i, counts[2]) && ReadCacheCounter(bitsCounters[1], i, counts[3]);
+        cout << CACHE_EVENTS[i].name;
+        if (!counted) {
+            cout << " unavailable" << endl;
+            continue;
+        }
+        for (int j = 0; j < 4; j++) cout << " " << (double)counts[j] / allTurns;
+        cout << endl;
+    }
+#else
+    cout << "Cache events cannot be counted on this platform" << endl;
+#endif
+    for (int layout = 0; layout < 2; layout++) {
+        CloseCacheCounters(listCounters[layout]);
+        CloseCacheCounters(bitsCounters[layout]);
+    }
+    cout << (mismatches == 0 ? "PASS" : "FAIL") << ": " << mismatches << " turns with different families or pools" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+/*
+ * RunSnapshotBenchmark
+ * Plays gamesPerLength games of every word length with the named guesser and
+ * SIMULATION_GUESSES guesses, and before every turn and at the end of won
+ * games saves and restores the game SNAPSHOT_BENCHMARK_RUNS times (lost games
+ * have no guesses left and cannot be restored).  Prints, by turn, the mean
+ * snapshot size (against the pool's words as text), how often the pool was
+ * stored as gaps rather than bits, and the mean save and restore times.
+ * Returns 1 if a restored game ever differs from the saved one.
+ */
+int RunSnapshotBenchmark(int gamesPerLength, string guesserName) {
+    Guesser guesser;
+    if (!FindGuesser(guesserName, guesser)) {
+        cout << "Unknown guesser " << guesserName << endl;
+        return 1;
+    }
+    if (gamesPerLength < 1) return 1;
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, GetLargestWordBucketSize(wordBuckets));
+    
+    int pointCount = SIMULATION_GUESSES + (int)ALPHABET.size() + 1;
+    vector<long> states(pointCount, 0), gapStates(pointCount, 0);
+    vector<double> snapshotBytes(pointCount, 0), textBytes(pointCount, 0);
+    vector<double> saveMicroseconds(pointCount, 0), restoreMicroseconds(pointCount, 0);
+    long mismatches = 0;
+    unsigned int randomSeed = SIMULATION_RANDOM_SEED;
+    HangmanGame game, restoredGame;
+    string snapshot;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        WordBucket& wordBucket = wordBuckets[wordLength];
+        if (wordBucket.wordCount == 0) continue;
+        for (int gameNumber = 0; gameNumber < gamesPerLength; gameNumber++) {
+            StartHangmanGame(wordBuckets, wordLength, SIMULATION_GUESSES, game);
+            for (int turn = 0; game.guessesRemaining > 0; turn++) {
+                double startTime = GetMicroseconds();
+                for (int run = 0; run < SNAPSHOT_BENCHMARK_RUNS; run++) {
+                    SaveHangmanGame(wordBucket, game, snapshot);
+                }
+                double saveTime = GetMicroseconds();
+                bool restored = true;
+                for (int run = 0; run < SNAPSHOT_BENCHMARK_RUNS; run++) {
+                    restored = RestoreHangmanGame(wordBuckets, snapshot, restoredGame) && restored;
+                }
+                restoreMicroseconds[turn] += (GetMicroseconds() - saveTime) / SNAPSHOT_BENCHMARK_RUNS;
+                saveMicroseconds[turn] += (saveTime - startTime) / SNAPSHOT_BENCHMARK_RUNS;
+                if (!restored || restoredGame.wordLength != game.wordLength || restoredGame.guessesRemaining != game.guessesRemaining ||
+                    restoredGame.guessedWord != game.guessedWord || restoredGame.charactersGuessed != game.charactersGuessed ||
+                    restoredGame.possibleWords != game.possibleWords) {
+                    mismatches++;
+                }
+                states[turn]++;
+                snapshotBytes[turn] += snapshot.size();
+                textBytes[turn] += game.possibleWords.size() * (wordLength + 1.0);
+                if (((const GameSnapshotHeader*)snapshot.data())->poolEncoding == SNAPSHOT_POOL_GAPS) gapStates[turn]++;
+                
+                if (IsWordGuessed(game.guessedWord)) break;
+                char guessChar = guesser.guessLetter(wordBucket, game, partitionScratch, randomSeed);
+                PlayHangmanGuess(wordBuckets, game, guessChar, partitionScratch, NULL, 0);
+            }
+        }
+    }
+    
+    cout << "Guesser " << guesser.name << ", " << SIMULATION_GUESSES << " guesses, " << gamesPerLength << " games per length" << endl;
+    cout << "turn states bytes textbytes gaps% saveus restoreus" << endl;
+    for (int turn = 0; turn < pointCount; turn++) {
+        if (states[turn] == 0) continue;
+        cout << turn << " " << states[turn] << " " << snapshotBytes[turn] / states[turn] << " " << textBytes[turn] / states[turn] << " "
+             << 100.0 * gapStates[turn] / states[turn] << " " << saveMicroseconds[turn] / states[turn] << " "
+             << restoreMicroseconds[turn] / states[turn] << endl;
+    }
+    cout << (mismatches == 0 ? "PASS" : "FAIL") << ": " << mismatches << " restored games differ" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+/*
+ * PlayCandidateGuess
+ * Plays a guess on a pool kept as CandidateBits the way an interactive turn
+ * does, choosing the family with ChooseCandidateFamily from the game's
+ * pattern and earlier guesses and then revealing it.  The game's own pool
+ * and guesses remaining are left alone.  Returns the family key.
+ */
+unsigned int PlayCandidateGuess(WordBucket& wordBucket, CandidateBits& candidateBits, HangmanGame& game, char guessChar, PartitionScratch& partitionScratch) {
+    unsigned int familyKey = ChooseCandidateFamily(guessChar, wordBucket, candidateBits, game.guessedWord, game.charactersGuessed, partitionScratch);
+    UpdateGuessedWordAndCharactersGuessed(familyKey, game.guessedWord, game.charactersGuessed, guessChar);
+    return familyKey;
+}
+
+/*
+ * RunOpeningBookCheck
+ * Plays every one and two letter opening of every word length with the
+ * opening book, once as a server game and once on CandidateBits as an
+ * interactive game, and again with live partitioning.  Checks that all three
+ * leave the same pattern and pool, and prints the mean time each takes per
+ * opening.  Returns 1 if there is no opening book for the dictionary or it
+ * disagrees with the live turns.
+ */
+int RunOpeningBookCheck() {
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    if (compiledDictionary.bookData == NULL) {
+        cout << "No opening book for this dictionary in " << OPENING_BOOK << endl;
+        return 1;
+    }
+    familyStrategy = FAMILY_STRATEGIES[0];
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, GetLargestWordBucketSize(wordBuckets));
+    HangmanGame bookGame, bitsGame, liveGame;
+    CandidateBits candidateBits;
+    vector<int> bitsWords;
+    long mismatches = 0;
+    
+    cout << "length words openings bookus bitsus liveus" << endl;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        WordBucket& wordBucket = wordBuckets[wordLength];
+        if (wordBucket.wordCount == 0) continue;
+        const OpeningBookEntry* openingBook = wordBucket.openingBook;
+        double bookMicroseconds = 0, bitsMicroseconds = 0, liveMicroseconds = 0;
+        int openings = 0;
+        for (size_t first = 0; first < ALPHABET.size(); first++) {
+            for (size_t second = 0; second < ALPHABET.size(); second++, openings++) {
+                StartHangmanGame(wordBuckets, wordLength, (int)ALPHABET.size(), bookGame);
+                double startTime = GetMicroseconds();
+                PlayHangmanGuess(wordBuckets, bookGame, ALPHABET[first], partitionScratch, NULL, 0);
+                if (second != first) PlayHangmanGuess(wordBuckets, bookGame, ALPHABET[second], partitionScratch, NULL, 0);
+                bookMicroseconds += GetMicroseconds() - startTime;
+                
+                StartHangmanGame(wordBuckets, wordLength, (int)ALPHABET.size(), bitsGame);
+                InitializeCandidateBits(wordBucket, candidateBits);
+                startTime = GetMicroseconds();
+                PlayCandidateGuess(wordBucket, candidateBits, bitsGame, ALPHABET[first], partitionScratch);
+                if (second != first) PlayCandidateGuess(wordBucket, candidateBits, bitsGame, ALPHABET[second], partitionScratch);
+                bitsMicroseconds += GetMicroseconds() - startTime;
+                ListCandidateBits(candidateBits, bitsWords);
+                
+                wordBucket.openingBook = NULL;
+                StartHangmanGame(wordBuckets, wordLength, (int)ALPHABET.size(), liveGame);
+                startTime = GetMicroseconds();
+                PlayHangmanGuess(wordBuckets, liveGame, ALPHABET[first], partitionScratch, NULL, 0);
+                if (second != first) PlayHangmanGuess(wordBuckets, liveGame, ALPHABET[second], partitionScratch, NULL, 0);
+                liveMicroseconds += GetMicroseconds() - startTime;
+                wordBucket.openingBook = openingBook;
+                
+                if (bookGame.guessedWord != liveGame.guessedWord || bookGame.possibleWords != liveGame.possibleWords) {
+                    cout << "Length " << wordLength << " opening " << ALPHABET[first];
+                    if (second != first) cout << ALPHABET[second];
+                    cout << ": book gives " << bookGame.guessedWord << " with " << bookGame.possibleWords.size()
+                         << " words, live gives " << liveGame.guessedWord << " with " << liveGame.possibleWords.size() << endl;
+                    mismatches++;
+                }
+                if (bitsGame.guessedWord != liveGame.guessedWord || bitsWords != liveGame.possibleWords) {
+                    cout << "Length " << wordLength << " opening " << ALPHABET[first];
+                    if (second != first) cout << ALPHABET[second];
+                    cout << ": interactive book gives " << bitsGame.guessedWord << " with " << bitsWords.size()
+                         << " words, live gives " << liveGame.guessedWord << " with " << liveGame.possibleWords.size() << endl;
+                    mismatches++;
+                }
+            }
+        }
+        cout << wordLength << " " << wordBucket.wordCount << " " << openings << " "
+             << bookMicroseconds / openings << " " << bitsMicroseconds / openings << " " << liveMicroseconds / openings << endl;
+    }
+    cout << (mismatches == 0 ? "PASS" : "FAIL") << ": " << mismatches << " openings differ from live turns" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+/*
+ * RunSampledFamilyReport
+ * Plays every one and two letter opening of each word length with a bucket
+ * of at least SAMPLED_FAMILY_MIN_POOL words (the second guess on the pool
+ * the exact first guess leaves), with FindLargestWordFamily and again with
+ * FindSampledWordFamily, on every turn whose pool is large enough to
+ * sample.  Prints, by length, how many such turns the sampled family
+ * differs from the exact one on, the share of the exact families' words
+ * those turns lose, and the mean time of each.
+ */
+int RunSampledFamilyReport() {
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, GetLargestWordBucketSize(wordBuckets));
+    partitionScratch.turnDeadline = 0;
+    vector<int> firstWords, exactWords, sampledWords;
+    long totalTurns = 0, totalDiffering = 0;
+    
+    cout << "length words turns differing lost% exactus sampledus saved%" << endl;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        WordBucket& wordBucket = wordBuckets[wordLength];
+        if ((size_t)wordBucket.wordCount < SAMPLED_FAMILY_MIN_POOL) continue;
+        double exactMicroseconds = 0, sampledMicroseconds = 0;
+        long turns = 0, differing = 0, exactFamilyWords = 0, lostWords = 0;
+        for (size_t first = 0; first < ALPHABET.size(); first++) {
+            InitializePossibleWordIndices(wordBucket, firstWords);
+            for (size_t second = first; second < ALPHABET.size() + first; second++) {
+                char guessChar = ALPHABET[second % ALPHABET.size()];
+                if (firstWords.size() < SAMPLED_FAMILY_MIN_POOL) break;
+                exactWords = firstWords;
+                sampledWords = firstWords;
+                double startTime = GetMicroseconds();
+                unsigned int exactKey = FindLargestWordFamily(guessChar, wordBucket, exactWords, partitionScratch);
+                double sampledTime = GetMicroseconds();
+                unsigned int sampledKey = FindSampledWordFamily(guessChar, wordBucket, sampledWords, partitionScratch);
+                sampledMicroseconds += GetMicroseconds() - sampledTime;
+                exactMicroseconds += sampledTime - startTime;
+                turns++;
+                exactFamilyWords += exactWords.size();
+                if (sampledKey != exactKey) {
+                    differing++;
+                    lostWords += exactWords.size() - sampledWords.size();
+                }
+                if (second == first) firstWords = exactWords;
+            }
+        }
+        totalTurns += turns;
+        totalDiffering += differing;
+        cout << wordLength << " " << wordBucket.wordCount << " " << turns << " " << differing << " "
+             << 100.0 * lostWords / max(1L, exactFamilyWords) << " " << exactMicroseconds / max(1L, turns) << " "
+             << sampledMicroseconds / max(1L, turns) << " " << 100 * (1 - sampledMicroseconds / max(1e-9, exactMicroseconds)) << endl;
+    }
+    cout << totalDiffering << " of " << totalTurns << " sampled turns differ from exact turns" << endl;
+    return 0;
+}
+
+/*
+ * RunFamilyMaskKernelBenchmark
+ * Checks that every supported family mask kernel gives the scalar kernel's
+ * keys for every letter over every word bucket, then times each kernel making
+ * all 26 letters' keys for the whole dictionary and prints masks per second.
+ * Returns 1 if any kernel disagrees with the scalar one.
+ */
+int RunFamilyMaskKernelBenchmark() {
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    vector<FamilyMaskKernel> kernels = GetSupportedFamilyMaskKernels();
+    
+    size_t maskCount = 0;
+    vector<unsigned int> expectedKeys, familyKeys;
+    bool kernelsAgree = true;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        WordBucket& wordBucket = wordBuckets[wordLength];
+        expectedKeys.resize(wordBucket.wordCount + 1);
+        familyKeys.resize(wordBucket.wordCount + 1);
+        for (size_t letter = 0; letter < ALPHABET.size(); letter++) {
+            maskCount += wordBucket.wordCount;
+            MakeBucketFamilyKeysScalar(wordBucket.words, wordLength, wordBucket.wordCount, ALPHABET[letter], &expectedKeys[0]);
+            for (size_t kernel = 1; kernel < kernels.size(); kernel++) {
+                kernels[kernel].makeFamilyKeys(wordBucket.words, wordLength, wordBucket.wordCount, ALPHABET[letter], &familyKeys[0]);
+                if (!equal(expectedKeys.begin(), expectedKeys.begin() + wordBucket.wordCount, familyKeys.begin())) {
+                    cout << "Kernel " << kernels[kernel].name << " disagrees on length " << wordLength << " letter " << ALPHABET[letter] << endl;
+                    kernelsAgree = false;
+                }
+            }
+        }
+    }
+    
+    for (size_t kernel = 0; kernel < kernels.size(); kernel++) {
+        double bestMicroseconds = 0;
+        for (int run = 0; run < KERNEL_BENCHMARK_RUNS; run++) {
+            double startTime = GetMicroseconds();
+            for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+                WordBucket& wordBucket = wordBuckets[wordLength];
+                for (size_t letter = 0; letter < ALPHABET.size(); letter++) {
+                    kernels[kernel].makeFamilyKeys(wordBucket.words, wordLength, wordBucket.wordCount, ALPHABET[letter], &familyKeys[0]);
+                }
+            }
+            double microseconds = GetMicroseconds() - startTime;
+            if (run == 0 || microseconds < bestMicroseconds) bestMicroseconds = microseconds;
+        }
+        cout << kernels[kernel].name << ": " << maskCount / bestMicroseconds << " million masks per second" << endl;
+    }
+    cout << (kernelsAgree ? "All kernels agree." : "Kernels DISAGREE.") << endl;
+    return kernelsAgree ? 0 : 1;
+}
+
+/*
+ * RunWordLengthKernelBenchmark
+ * Checks the unrolled word length kernels against the generic loops they
+ * replace on every word bucket, and prints for each length the best of
+ * KERNEL_BENCHMARK_RUNS times, generic then unrolled, to make all 26
+ * letters' family keys for the bucket (us), to build its letter mask and
+ * letter bit indexes (us), and to reveal a family in a pattern and check
+ * the pattern for blanks (ns).  Returns 1 if any kernel disagrees.
+ */
+int RunWordLengthKernelBenchmark() {
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    vector<unsigned int> genericKeys, unrolledKeys, genericMasks, unrolledMasks;
+    vector<uint64_t> genericBits, unrolledBits;
+    bool kernelsAgree = true;
+    
+    cout << "length words keysus unrolledus masksus unrolledus bitsus unrolledus revealns unrolledns" << endl;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        WordBucket& wordBucket = wordBuckets[wordLength];
+        int wordCount = wordBucket.wordCount;
+        if (wordCount == 0) continue;
+        const WordLengthKernels& kernels = WORD_LENGTH_KERNELS[wordLength];
+        size_t bitCount = ALPHABET.size() * (wordLength + 1) * (size_t)wordBucket.blockCount;
+        genericKeys.resize(wordCount);
+        unrolledKeys.resize(wordCount);
+        double times[8];
+        for (int i = 0; i < 8; i++) times[i] = 0;
+        bool blanksAgree = true;
+        string genericPattern, unrolledPattern;
+        for (int run = 0; run < KERNEL_BENCHMARK_RUNS; run++) {
+            double runTimes[8];
+            double startTime = GetMicroseconds();
+            for (size_t letter = 0; letter < ALPHABET.size(); letter++) {
+                MakeBucketFamilyKeysScalar(wordBucket.words, wordLength, wordCount, ALPHABET[letter], &genericKeys[0]);
+            }
+            runTimes[0] = GetMicroseconds() - startTime;
+            startTime = GetMicroseconds();
+            for (size_t letter = 0; letter < ALPHABET.size(); letter++) {
+                kernels.makeFamilyKeys(wordBucket.words, wordCount, ALPHABET[letter], &unrolledKeys[0]);
+            }
+            runTimes[1] = GetMicroseconds() - startTime;
+            
+            startTime = GetMicroseconds();
+            genericMasks.assign(ALPHABET.size() * wordCount, 0);
+            AddLetterMasksGeneric(wordBucket.words, wordLength, wordCount, &genericMasks[0]);
+            runTimes[2] = GetMicroseconds() - startTime;
+            startTime = GetMicroseconds();
+            unrolledMasks.assign(ALPHABET.size() * wordCount, 0);
+            kernels.addLetterMasks(wordBucket.words, wordCount, &unrolledMasks[0]);
+            runTimes[3] = GetMicroseconds() - startTime;
+            
+            startTime = GetMicroseconds();
+            genericBits.assign(bitCount, 0);
+            AddLetterBitsGeneric(wordBucket.words, wordLength, wordCount, wordBucket.blockCount, &genericBits[0]);
+            runTimes[4] = GetMicroseconds() - startTime;
+            startTime = GetMicroseconds();
+            unrolledBits.assign(bitCount, 0);
+            kernels.addLetterBits(wordBucket.words, wordCount, wordBucket.blockCount, &unrolledBits[0]);
+            runTimes[5] = GetMicroseconds() - startTime;
+            
+            /* Reveal each word's 'e' family in a blank pattern, as a turn does */
+            const unsigned int* letterMaskColumn = GetLetterMaskColumn(wordBucket, 'e');
+            long blankCount = 0;
+            startTime = GetMicroseconds();
+            for (int i = 0; i < wordCount; i++) {
+                InitializeGuessedWord(wordLength, genericPattern);
+                RevealFamilyGeneric(letterMaskColumn[i], &genericPattern[0], wordLength, 'e');
+                blankCount += HasBlankGeneric(genericPattern.data(), wordLength);
+            }
+            runTimes[6] = (GetMicroseconds() - startTime) * 1000 / wordCount;
+            startTime = GetMicroseconds();
+            for (int i = 0; i < wordCount; i++) {
+                InitializeGuessedWord(wordLength, unrolledPattern);
+                kernels.revealFamily(letterMaskColumn[i], &unrolledPattern[0], 'e');
+                blankCount -= kernels.hasBlank(unrolledPattern.data());
+            }
+            runTimes[7] = (GetMicroseconds() - startTime) * 1000 / wordCount;
+            blanksAgree = blanksAgree && blankCount == 0 && genericPattern == unrolledPattern;
+            
+            for (int i = 0; i < 8; i++) {
+                if (run == 0 || runTimes[i] < times[i]) times[i] = runTimes[i];
+            }
+        }
+        if (genericKeys != unrolledKeys || genericMasks != unrolledMasks || genericBits != unrolledBits || !blanksAgree) {
+            cout << "Word length kernels disagree on length " << wordLength << endl;
+            kernelsAgree = false;
+        }
+        cout << wordLength << " " << wordCount;
+        for (int i = 0; i < 8; i++) cout << " " << times[i];
+        cout << endl;
+    }
+    cout << (kernelsAgree ? "All word length kernels agree." : "Word length kernels DISAGREE.") << endl;
+    return kernelsAgree ? 0 : 1;
+}
+
+/*
+ * GetResidentKilobytes
+ * Returns the process's resident set size in kilobytes, or 0 if it cannot be
+ * read from /proc.
+ */
+long GetResidentKilobytes() {
+    ifstream statusFile("/proc/self/statm");
+    long totalPages = 0, residentPages = 0;
+    if (!(statusFile >> totalPages >> residentPages)) return 0;
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*
+ * RunMemoryReport
+ * Reports resident memory after loading the dictionary, after starting one
+ * game and playing its first guess, and after doing the same for
+ * sessionCount games held at once, as a server would.  Games cycle through
+ * word lengths 4 to 12 like the load test and guess 'e', and their turns
+ * share one partition scratch space as a server worker's do.
+ */
+int RunMemoryReport(int sessionCount) {
+    if (sessionCount < 1) return 1;
+    long startKilobytes = GetResidentKilobytes();
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, GetLargestWordBucketSize(wordBuckets));
+    long loadedKilobytes = GetResidentKilobytes();
+    
+    vector<HangmanGame> games(sessionCount);
+    long gamesKilobytes = GetResidentKilobytes();
+    long oneGameKilobytes = 0;
+    for (int i = 0; i < sessionCount; i++) {
+        StartHangmanGame(wordBuckets, 4 + i % 9, LOAD_TEST_GUESSES, games[i]);
+        PlayHangmanGuess(wordBuckets, games[i], 'e', partitionScratch, NULL, 0);
+        if (i == 0) oneGameKilobytes = GetResidentKilobytes() - gamesKilobytes;
+    }
+    long sessionsKilobytes = GetResidentKilobytes() - loadedKilobytes;
+    cout << "Dictionary and scratch space: " << loadedKilobytes - startKilobytes << " KB" << endl;
+    cout << "One game: " << oneGameKilobytes << " KB" << endl;
+    cout << sessionCount << " games: " << sessionsKilobytes << " KB (" << (double)sessionsKilobytes / sessionCount << " KB per game)" << endl;
+    UnmapCompiledDictionary(compiledDictionary);
+    return 0;
+}
+
+#ifdef COUNT_ALLOCATIONS
+/*
+ * RunAllocationCheck
+ * Plays a game of every word length through PlayHangmanGuess, guessing letters
+ * in order of English frequency, and counts the heap allocations made during
+ * the turns (not while the game is set up).  Prints the count for each length
+ * and returns 1 if any turn allocated.
+ */
+int RunAllocationCheck() {
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    
+    long totalAllocations = 0;
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, GetLargestWordBucketSize(wordBuckets));
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        HangmanGame game;
+        if (!StartHangmanGame(wordBuckets, wordLength, (int)LETTER_FREQUENCY_ORDER.size(), game)) continue;
+        long allocationsBefore = allocationCount;
+        int turns = 0;
+        while (turns < (int)LETTER_FREQUENCY_ORDER.size() && game.guessesRemaining > 0 && !IsWordGuessed(game.guessedWord)) {
+            PlayHangmanGuess(wordBuckets, game, LETTER_FREQUENCY_ORDER[turns++], partitionScratch, NULL, 0);
+        }
+        long allocations = allocationCount - allocationsBefore;
+        totalAllocations += allocations;
+        cout << "Length " << wordLength << ": " << turns << " turns, " << allocations << " allocations" << endl;
+    }
+    cout << (totalAllocations == 0 ? "PASS" : "FAIL") << ": " << totalAllocations << " allocations during turns" << endl;
+    return totalAllocations == 0 ? 0 : 1;
+}
+#endif
+
+
+/* Main function */
+
+int main (int argc, char* argv[]) {
+    /* Games write through cout's own buffer */
+    ios::sync_with_stdio(false);
+    
+    /* Partition tuning, metrics export and the replay log may lead any command */
+    long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (!ReadCommandOptions(argc, argv)) return 1;
+    
+    /* Opening book check against live turns */
+    if (argc > 1 && string(argv[1]) == "-checkbook") {
+        return RunOpeningBookCheck();
+    }
+    
+    /* Game server load test client */
+    if (argc > 2 && string(argv[1]) == "-loadtest") {
+        int clientCount = argc > 3 ? atoi(argv[3]) : 1000;
+        int gamesPerClient = argc > 4 ? atoi(argv[4]) : 10;
+        return RunLoadTest(argv[2], clientCount, gamesPerClient);
+    }
+    
+    /* Partition thread scaling benchmark */
+    if (argc > 1 && string(argv[1]) == "-scaling") {
+        return RunPartitionScaling(argc > 2 ? atoi(argv[2]) : partitionThreadCount);
+    }
+    
+    /* Headless simulation benchmark */
+    if (argc > 1 && string(argv[1]) == "-simulate") {
+        int gamesPerLength = argc > 2 ? atoi(argv[2]) : SIMULATION_GAMES;
+        string guesserName = argc > 3 ? argv[3] : "all";
+        int threadCount = argc > 4 ? atoi(argv[4]) : (coreCount > 1 ? (int)coreCount : 1);
+        int guesses = argc > 5 ? atoi(argv[5]) : SIMULATION_GUESSES;
+        return RunSimulation(gamesPerLength, guesserName, threadCount, guesses);
+    }
+    
+    /* Logged games replayed and checked */
+    if (argc > 2 && string(argv[1]) == "-replay") {
+        int threadCount = argc > 3 ? atoi(argv[3]) : (coreCount > 1 ? (int)coreCount : 1);
+        vector<string> dictionaryFileNames(argv + min(argc, 4), argv + argc);
+        return RunReplay(argv[2], threadCount, dictionaryFileNames);
+    }
+    
+    /* Lookahead strategy latency against search depth */
+    if (argc > 1 && string(argv[1]) == "-lookahead") {
+        int gamesPerLength = argc > 2 ? atoi(argv[2]) : LOOKAHEAD_BENCHMARK_GAMES;
+        int maxDepth = argc > 3 ? atoi(argv[3]) : LOOKAHEAD_BENCHMARK_DEPTH;
+        string guesserName = argc > 4 ? argv[4] : "frequency";
+        return RunLookaheadBenchmark(gamesPerLength, maxDepth, guesserName);
+    }
+    
+    /* Candidate pools as lists against bitsets */
+    if (argc > 1 && string(argv[1]) == "-bitset") {
+        int gamesPerLength = argc > 2 ? atoi(argv[2]) : SIMULATION_GAMES;
+        string guesserName = argc > 3 ? argv[3] : "frequency";
+        return RunCandidateBitsBenchmark(gamesPerLength, guesserName);
+    }
+    
+    /* Turn time and cache events of the compiled dictionary's order against alphabetical */
+    if (argc > 1 && string(argv[1]) == "-locality") {
+        int gamesPerLength = argc > 2 ? atoi(argv[2]) : SIMULATION_GAMES;
+        string guesserName = argc > 3 ? argv[3] : "frequency";
+        return RunLocalityReport(gamesPerLength, guesserName);
+    }
+    
+    /* Game snapshot size and speed */
+    if (argc > 1 && string(argv[1]) == "-snapshot") {
+        int gamesPerLength = argc > 2 ? atoi(argv[2]) : SNAPSHOT_BENCHMARK_GAMES;
+        string guesserName = argc > 3 ? argv[3] : "frequency";
+        return RunSnapshotBenchmark(gamesPerLength, guesserName);
+    }
+    
+    /* Word length kernels against the generic loops */
+    if (argc > 1 && string(argv[1]) == "-lengths") {
+        return RunWordLengthKernelBenchmark();
+    }
+    
+    /* Sampled largest families against exact ones */
+    if (argc > 1 && string(argv[1]) == "-sampled") {
+        return RunSampledFamilyReport();
+    }
+    
+    /* Family mask kernel check and microbenchmark */
+    if (argc > 1 && string(argv[1]) == "-kernels") {
+        return RunFamilyMaskKernelBenchmark();
+    }
+    
+    /* Resident memory per hosted game */
+    if (argc > 1 && string(argv[1]) == "-memory") {
+        return RunMemoryReport(argc > 2 ? atoi(argv[2]) : 10000);
+    }
+    
+#ifdef COUNT_ALLOCATIONS
+    /* Check that turns do not allocate */
+    if (argc > 1 && string(argv[1]) == "-alloccheck") {
+        return RunAllocationCheck();
+    }
+#endif
+    
+    cout << "Usage: evilHangmanBench [options] -simulate | -replay <log> | -loadtest <address> | -scaling | -lookahead |" << endl
+         << "       -checkbook | -bitset | -locality | -snapshot | -lengths | -sampled | -kernels | -memory";
+#ifdef COUNT_ALLOCATIONS
+    cout << " | -alloccheck";
+#endif
+    cout << endl;
+    return 1;
+}
@@ -0,0 +1,3104 @@
+/******************************************************
+ * File: hangman.cpp
+ * Author: John Yang-Sammataro
+ *
+ * The evil hangman turn engine shared by the game and server
+ * (main.cpp) and the evilHangmanBench tool (benchmarks.cpp):
+ * compiling, streaming and loading dictionaries and the opening
+ * book, partitioning candidate pools into word families with each
+ * family strategy, the partition cache, game snapshots, replay logs,
+ * turn metrics and the options leading every command.
+ */
+
+/* Include libraries and header files */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <set>
+#include <map>
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <climits>
+#include <csignal>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "hangman.h"
+#ifdef HAVE_X86_FAMILY_MASK_KERNELS
+#include <immintrin.h>
+#endif
+/* The bitset pool routines also get a clone using POPCNT, chosen at load time
+   through an ELF ifunc, which Mach-O lacks */
+#if defined(HAVE_X86_FAMILY_MASK_KERNELS) && defined(__linux__)
+#define POPCOUNT_CLONES __attribute__((target_clones("popcnt", "default")))
+#else
+#define POPCOUNT_CLONES
+#endif
+using namespace std;
+
+/* Partition tuning, set from the command line by ReadCommandOptions */
+int partitionThreadCount = 1;
+int parallelPartitionThreshold = PARALLEL_PARTITION_THRESHOLD;
+long partitionCacheWords = PARTITION_CACHE_WORDS;
+int partitionCachePrewarm = PARTITION_CACHE_PREWARM;
+int lookaheadDepth = LOOKAHEAD_DEPTH;
+double lookaheadBudget = LOOKAHEAD_BUDGET_MICROSECONDS;
+double turnDeadline = TURN_DEADLINE_MICROSECONDS;
+
+#if defined(COUNT_ALLOCATIONS) || defined(TURN_METRICS)
+/*
+ * Built with -DCOUNT_ALLOCATIONS, every operator new in the process is
+ * counted so that "evilHangmanBench -alloccheck" can prove turns do not allocate.
+ * Turn metrics use the byte count.
+ */
+long allocationCount = 0;
+long allocatedBytes = 0;
+
+/* Out of line, so GCC never pairs the malloc below with a sized delete */
+__attribute__((noinline)) void* operator new(size_t size) {
+    __sync_fetch_and_add(&allocationCount, 1);
+    __sync_fetch_and_add(&allocatedBytes, (long)size);
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == NULL) throw bad_alloc();
+    return memory;
+}
+
+/* Out of line, so GCC does not mistake the free for a mismatched delete */
+__attribute__((noinline)) void operator delete(void* memory) throw() {
+    free(memory);
+}
+
+#ifdef __cpp_sized_deallocation
+/* C++14 and later also call the sized form */
+__attribute__((noinline)) void operator delete(void* memory, size_t) throw() {
+    free(memory);
+}
+#endif
+#endif
+
+/* Family choosing strategies, the first of them the default */
+const FamilyStrategy FAMILY_STRATEGIES[] = {
+    {"greedy", ChooseLargestWordFamily, ChooseLargestFamilyInBits},
+    {"lookahead", ChooseLookaheadWordFamily, NULL},
+    {"sampled", ChooseSampledWordFamily, ChooseLargestFamilyInBits}
+};
+
+/* Word length kernels for every length up to MAX_WORD_LENGTH, by length */
+#define WORD_LENGTH_KERNELS_FOR(length) \
+    {MakeLengthFamilyKeys<length>, AddLengthLetterMasks<length>, AddLengthLetterBits<length>, RevealLengthFamily<length>, HasLengthBlank<length>}
+const WordLengthKernels WORD_LENGTH_KERNELS[MAX_WORD_LENGTH + 1] = {
+    WORD_LENGTH_KERNELS_FOR(0), WORD_LENGTH_KERNELS_FOR(1), WORD_LENGTH_KERNELS_FOR(2), WORD_LENGTH_KERNELS_FOR(3),
+    WORD_LENGTH_KERNELS_FOR(4), WORD_LENGTH_KERNELS_FOR(5), WORD_LENGTH_KERNELS_FOR(6), WORD_LENGTH_KERNELS_FOR(7),
+    WORD_LENGTH_KERNELS_FOR(8), WORD_LENGTH_KERNELS_FOR(9), WORD_LENGTH_KERNELS_FOR(10), WORD_LENGTH_KERNELS_FOR(11),
+    WORD_LENGTH_KERNELS_FOR(12), WORD_LENGTH_KERNELS_FOR(13), WORD_LENGTH_KERNELS_FOR(14), WORD_LENGTH_KERNELS_FOR(15),
+    WORD_LENGTH_KERNELS_FOR(16), WORD_LENGTH_KERNELS_FOR(17), WORD_LENGTH_KERNELS_FOR(18), WORD_LENGTH_KERNELS_FOR(19),
+    WORD_LENGTH_KERNELS_FOR(20), WORD_LENGTH_KERNELS_FOR(21), WORD_LENGTH_KERNELS_FOR(22), WORD_LENGTH_KERNELS_FOR(23),
+    WORD_LENGTH_KERNELS_FOR(24), WORD_LENGTH_KERNELS_FOR(25), WORD_LENGTH_KERNELS_FOR(26), WORD_LENGTH_KERNELS_FOR(27),
+    WORD_LENGTH_KERNELS_FOR(28), WORD_LENGTH_KERNELS_FOR(29), WORD_LENGTH_KERNELS_FOR(30), WORD_LENGTH_KERNELS_FOR(31)
+};
+
+/* The strategy turns are played with, set from the command line by ReadCommandOptions */
+FamilyStrategy familyStrategy = FAMILY_STRATEGIES[0];
+
+/* The replay log games are recorded to, opened from the command line by ReadCommandOptions */
+ReplayLog replayLog = {-1, PTHREAD_MUTEX_INITIALIZER};
+
+#ifdef TURN_METRICS
+/* Turn metrics, indexed by TurnMetric */
+MetricHistogram turnMetrics[METRIC_COUNT] = {
+    {"evilhangman_dictionary_load_microseconds", "Time to map or build the compiled dictionary", FIRST_LATENCY_BUCKET, 0, 0, {0}},
+    {"evilhangman_initialize_possible_words_microseconds", "Time to index the interactive game's word length", FIRST_LATENCY_BUCKET, 0, 0, {0}},
+    {"evilhangman_make_word_family_keys_microseconds", "Time to key a serially partitioned pool", FIRST_LATENCY_BUCKET, 0, 0, {0}},
+    {"evilhangman_count_largest_family_microseconds", "Time to count a serially partitioned pool's families", FIRST_LATENCY_BUCKET, 0, 0, {0}},
+    {"evilhangman_turn_microseconds", "Time to play a guess, not counting the prompt", FIRST_LATENCY_BUCKET, 0, 0, {0}},
+    {"evilhangman_pool_before_guess_words", "Candidate pool size before a guess", 1, 0, 0, {0}},
+    {"evilhangman_pool_after_guess_words", "Candidate pool size after a guess", 1, 0, 0, {0}},
+    {"evilhangman_families_generated", "Word families a guess split the pool into", 1, 0, 0, {0}},
+    {"evilhangman_turn_allocated_bytes", "Bytes allocated by the whole process during a turn", 1, 0, 0, {0}}
+};
+/* Where the metrics are written, empty when they are not exported */
+string metricsPath;
+#endif
+
+/* Functions */
+
+/*
+ * GetMicroseconds
+ * Returns the time in microseconds on a monotonic clock, for timing turns
+ * and benchmarks.
+ */
+double GetMicroseconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec * 1e-3;
+}
+
+/*
+ * OpenFile
+ * Takes in a filestream by reference and a
+ * file name.  Opens the file if is valid and
+ * throws an exception otherwise.
+ */
+void OpenFile(ifstream& input, string fileName) {
+    input.open(fileName.c_str());
+    if(!input.is_open()) {
+        cout << "Error reading " << fileName << endl;
+        input.clear();
+    }
+}
+
+/*
+ * ReadDictionary
+ * Takes in a dictionaryFile filestream, a string and a vector of dictionary
+ * words by reference.  The whole file is read into dictionaryText in one
+ * piece and dictionaryWords is set to a view of every distinct line in it, in
+ * the order of DictionaryWordOrder.  Empty lines and words longer than
+ * MAX_WORD_LENGTH are skipped since their families cannot be keyed.
+ */
+void ReadDictionary(ifstream& dictionaryFile, string& dictionaryText, vector<DictionaryWord>& dictionaryWords) {
+    dictionaryFile.seekg(0, ios::end);
+    streamoff fileSize = dictionaryFile.tellg();
+    dictionaryFile.seekg(0, ios::beg);
+    dictionaryText.assign(fileSize > 0 ? (size_t)fileSize : 0, '\0');
+    if (fileSize > 0) dictionaryFile.read(&dictionaryText[0], fileSize);
+    
+    dictionaryWords.clear();
+    size_t lineStart = 0;
+    while (lineStart < dictionaryText.size()) {
+        size_t lineEnd = dictionaryText.find('\n', lineStart);
+        if (lineEnd == string::npos) lineEnd = dictionaryText.size();
+        if (lineEnd > lineStart && lineEnd - lineStart <= MAX_WORD_LENGTH) {
+            DictionaryWord word = {(uint32_t)lineStart, (uint32_t)(lineEnd - lineStart),
+                                   GetWordSignature(dictionaryText.data() + lineStart, (int)(lineEnd - lineStart))};
+            dictionaryWords.push_back(word);
+        }
+        lineStart = lineEnd + 1;
+    }
+    DictionaryWordOrder wordOrder = {dictionaryText.data(), true};
+    sort(dictionaryWords.begin(), dictionaryWords.end(), wordOrder);
+    size_t distinctWords = 0;
+    for (size_t i = 0; i < dictionaryWords.size(); i++) {
+        if (distinctWords == 0 || wordOrder(dictionaryWords[distinctWords - 1], dictionaryWords[i])) {
+            dictionaryWords[distinctWords++] = dictionaryWords[i];
+        }
+    }
+    dictionaryWords.resize(distinctWords);
+}
+
+/*
+ * GetWordSignature
+ * Returns the set of letters in a word as a 26 bit key with the most
+ * frequent letter in English (LETTER_FREQUENCY_ORDER) as its highest bit, so
+ * that words sorted by it are grouped first by whether they hold an e, then
+ * an s, and so on.  Characters outside a-z are left out.
+ */
+uint32_t GetWordSignature(const char* word, int wordLength) {
+    unsigned int letters = 0;
+    for (int i = 0; i < wordLength; i++) {
+        if (word[i] >= 'a' && word[i] <= 'z') letters |= GetLetterBit(word[i]);
+    }
+    uint32_t signature = 0;
+    for (size_t rank = 0; rank < LETTER_FREQUENCY_ORDER.size() && letters != 0; rank++) {
+        if (letters & GetLetterBit(LETTER_FREQUENCY_ORDER[rank])) {
+            signature |= 1u << (LETTER_FREQUENCY_ORDER.size() - 1 - rank);
+            letters &= ~GetLetterBit(LETTER_FREQUENCY_ORDER[rank]);
+        }
+    }
+    return signature;
+}
+
+/*
+ * BuildCompiledDictionary
+ * Takes in the text dictionary file name and a string by reference, reads the
+ * text dictionary and lays it out in the string in the compiled format
+ * described at CompiledDictionaryHeader.  Returns false if the file cannot be
+ * read, leaving an image with no words.
+ */
+bool BuildCompiledDictionary(string dictionaryFileName, string& compiledData) {
+    ifstream dictionaryFile;
+    string dictionaryText;
+    vector<DictionaryWord> dictionaryWords;
+    OpenFile(dictionaryFile, dictionaryFileName);
+    bool fileRead = dictionaryFile.is_open();
+    if (fileRead) ReadDictionary(dictionaryFile, dictionaryText, dictionaryWords);
+    LayOutCompiledDictionary(dictionaryText, dictionaryWords, compiledData);
+    return fileRead;
+}
+
+/*
+ * LayOutCompiledDictionary
+ * Takes in a text, views of the words in it in the order of
+ * DictionaryWordOrder and a string by reference, and lays the words out in
+ * the string in the compiled format described at CompiledDictionaryHeader.
+ */
+void LayOutCompiledDictionary(const string& dictionaryText, vector<DictionaryWord>& dictionaryWords, string& compiledData) {
+    /* Lay out the length index, then each length's words on an aligned offset */
+    vector<CompiledBucketEntry> bucketEntries;
+    for (size_t i = 0; i < dictionaryWords.size(); i++) {
+        if (bucketEntries.empty() || bucketEntries.back().wordLength != dictionaryWords[i].length) {
+            CompiledBucketEntry entry = {dictionaryWords[i].length, 0, 0, 0};
+            bucketEntries.push_back(entry);
+        }
+        bucketEntries.back().wordCount++;
+    }
+    CompiledDictionaryHeader header;
+    memcpy(header.magic, COMPILED_DICTIONARY_MAGIC, sizeof(header.magic));
+    header.version = COMPILED_DICTIONARY_VERSION;
+    header.bucketCount = (uint32_t)bucketEntries.size();
+    uint32_t fileSize = sizeof(header) + header.bucketCount * sizeof(CompiledBucketEntry);
+    for (size_t i = 0; i < bucketEntries.size(); i++) {
+        fileSize = (fileSize + COMPILED_SECTION_ALIGNMENT - 1) / COMPILED_SECTION_ALIGNMENT * COMPILED_SECTION_ALIGNMENT;
+        bucketEntries[i].wordsOffset = fileSize;
+        fileSize += bucketEntries[i].wordCount * bucketEntries[i].wordLength;
+    }
+    header.fileSize = fileSize;
+    
+    compiledData.assign(fileSize, '\0');
+    memcpy(&compiledData[0], &header, sizeof(header));
+    if (!bucketEntries.empty()) {
+        memcpy(&compiledData[sizeof(header)], &bucketEntries[0], bucketEntries.size() * sizeof(CompiledBucketEntry));
+    }
+    size_t wordIndex = 0;
+    for (size_t i = 0; i < bucketEntries.size(); i++) {
+        char* wordOutput = &compiledData[bucketEntries[i].wordsOffset];
+        for (uint32_t j = 0; j < bucketEntries[i].wordCount; j++, wordIndex++) {
+            memcpy(wordOutput, dictionaryText.data() + dictionaryWords[wordIndex].offset, dictionaryWords[wordIndex].length);
+            wordOutput += dictionaryWords[wordIndex].length;
+        }
+    }
+}
+
+/*
+ * CompileDictionary
+ * Takes in the text dictionary file name and the compiled dictionary file name.
+ * Reads the text dictionary and writes it out in the compiled format described
+ * at CompiledDictionaryHeader.  Returns false if either file cannot be used.
+ */
+bool CompileDictionary(string dictionaryFileName, string compiledFileName) {
+    string compiledData;
+    if (!BuildCompiledDictionary(dictionaryFileName, compiledData)) return false;
+    ofstream compiledFile(compiledFileName.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!compiledFile.is_open()) {
+        cout << "Error writing " << compiledFileName << endl;
+        return false;
+    }
+    compiledFile.write(compiledData.data(), compiledData.size());
+    return compiledFile.good();
+}
+
+/*
+ * InitializeIngestQueue, PushIngestBlock, PopIngestBlock
+ * A blocking queue of ingest blocks between two stages of ingestion.
+ * PopIngestBlock waits until there is a block to take.
+ */
+void InitializeIngestQueue(IngestQueue& ingestQueue) {
+    pthread_mutex_init(&ingestQueue.lock, NULL);
+    pthread_cond_init(&ingestQueue.blockReady, NULL);
+    ingestQueue.blocks.clear();
+}
+
+void PushIngestBlock(IngestQueue& ingestQueue, IngestBlock* block) {
+    pthread_mutex_lock(&ingestQueue.lock);
+    ingestQueue.blocks.push_back(block);
+    pthread_cond_signal(&ingestQueue.blockReady);
+    pthread_mutex_unlock(&ingestQueue.lock);
+}
+
+IngestBlock* PopIngestBlock(IngestQueue& ingestQueue) {
+    pthread_mutex_lock(&ingestQueue.lock);
+    while (ingestQueue.blocks.empty()) {
+        pthread_cond_wait(&ingestQueue.blockReady, &ingestQueue.lock);
+    }
+    IngestBlock* block = ingestQueue.blocks.front();
+    ingestQueue.blocks.pop_front();
+    pthread_mutex_unlock(&ingestQueue.lock);
+    return block;
+}
+
+/*
+ * LowercaseWord
+ * Lowercases a word of wordLength characters in place and returns false if
+ * it holds any character other than the letters a-z, which are all a turn
+ * can key.
+ */
+bool LowercaseWord(char* word, int wordLength) {
+    for (int i = 0; i < wordLength; i++) {
+        if (word[i] >= 'A' && word[i] <= 'Z') word[i] += 'a' - 'A';
+        if (word[i] < 'a' || word[i] > 'z') return false;
+    }
+    return true;
+}
+
+/*
+ * HashWord
+ * Returns the 32-bit FNV-1a hash of a word of wordLength characters.
+ */
+uint32_t HashWord(const char* word, int wordLength) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < wordLength; i++) {
+        hash = (hash ^ (unsigned char)word[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * InsertDistinctWord
+ * Takes in a word hash set, the words it indexes at a stride of wordLength
+ * and the index of one of them, and adds that word to the set unless an
+ * equal word is in it already, in which case it returns false.  The table
+ * doubles whenever it would be more than half full.
+ */
+bool InsertDistinctWord(WordHashSet& wordHashSet, const char* words, int wordLength, uint32_t wordIndex) {
+    if (2 * (wordHashSet.count + 1) > wordHashSet.slots.size()) {
+        vector<uint32_t> oldSlots(max(2 * wordHashSet.slots.size(), (size_t)1024), EMPTY_WORD_SLOT);
+        oldSlots.swap(wordHashSet.slots);
+        size_t slotMask = wordHashSet.slots.size() - 1;
+        for (size_t i = 0; i < oldSlots.size(); i++) {
+            if (oldSlots[i] == EMPTY_WORD_SLOT) continue;
+            size_t slot = HashWord(words + (size_t)oldSlots[i] * wordLength, wordLength) & slotMask;
+            while (wordHashSet.slots[slot] != EMPTY_WORD_SLOT) slot = (slot + 1) & slotMask;
+            wordHashSet.slots[slot] = oldSlots[i];
+        }
+    }
+    const char* word = words + (size_t)wordIndex * wordLength;
+    size_t slotMask = wordHashSet.slots.size() - 1;
+    size_t slot = HashWord(word, wordLength) & slotMask;
+    while (wordHashSet.slots[slot] != EMPTY_WORD_SLOT) {
+        if (memcmp(words + (size_t)wordHashSet.slots[slot] * wordLength, word, wordLength) == 0) return false;
+        slot = (slot + 1) & slotMask;
+    }
+    wordHashSet.slots[slot] = wordIndex;
+    wordHashSet.count++;
+    return true;
+}
+
+/*
+ * ValidateIngestBlocks
+ * The validation stage of StreamDictionaryBucket, run on a thread of its
+ * own.  Splits each block into lines, drops a trailing carriage return and
+ * every line not wordLength characters long, lowercases the rest and lists
+ * the ones made only of letters in the block's wordOffsets.
+ */
+void* ValidateIngestBlocks(void* ingestPointer) {
+    DictionaryIngest& ingest = *(DictionaryIngest*)ingestPointer;
+    size_t wordLength = ingest.wordLength;
+    IngestBlock* block;
+    while ((block = PopIngestBlock(ingest.validateQueue)) != NULL) {
+        block->wordOffsets.clear();
+        char* data = &block->data[0];
+        size_t lineStart = 0;
+        while (lineStart < block->size) {
+            const char* newline = (const char*)memchr(data + lineStart, '\n', block->size - lineStart);
+            size_t lineEnd = newline != NULL ? newline - data : block->size;
+            size_t nextLineStart = lineEnd + 1;
+            if (lineEnd > lineStart && data[lineEnd - 1] == '\r') lineEnd--;
+            ingest.linesRead++;
+            if (lineEnd - lineStart == wordLength) {
+                if (LowercaseWord(data + lineStart, (int)wordLength)) {
+                    block->wordOffsets.push_back((uint32_t)lineStart);
+                } else {
+                    ingest.rejectedWords++;
+                }
+            }
+            lineStart = nextLineStart;
+        }
+        PushIngestBlock(ingest.keepQueue, block);
+    }
+    PushIngestBlock(ingest.keepQueue, NULL);
+    return NULL;
+}
+
+/*
+ * KeepIngestedWords
+ * The last stage of StreamDictionaryBucket, run on a thread of its own.
+ * Appends each validated word to the bucket unless it is already there,
+ * then hands the block back to the reader.
+ */
+void* KeepIngestedWords(void* ingestPointer) {
+    DictionaryIngest& ingest = *(DictionaryIngest*)ingestPointer;
+    int wordLength = ingest.wordLength;
+    IngestBlock* block;
+    while ((block = PopIngestBlock(ingest.keepQueue)) != NULL) {
+        for (size_t i = 0; i < block->wordOffsets.size(); i++) {
+            uint32_t wordIndex = (uint32_t)(ingest.bucketText.size() / wordLength);
+            ingest.bucketText.append(&block->data[block->wordOffsets[i]], wordLength);
+            if (!InsertDistinctWord(ingest.keptWords, ingest.bucketText.data(), wordLength, wordIndex)) {
+                ingest.bucketText.resize(ingest.bucketText.size() - wordLength);
+                ingest.duplicateWords++;
+            }
+        }
+        PushIngestBlock(ingest.freeBlocks, block);
+    }
+    return NULL;
+}
+
+/*
+ * StreamDictionaryBucket
+ * Takes in a word list file name, a word length and ingestion state by
+ * reference, and streams the file through three stages: this thread reads
+ * it in blocks of whole lines, ValidateIngestBlocks checks and lowercases
+ * the words of wordLength, and KeepIngestedWords keeps the distinct ones in
+ * bucketText, in the order first seen.  Lengths are in bytes, so words with
+ * letters outside a-z are rejected rather than miscounted.  A line too long
+ * for any bucket is never held whole.  Returns false if the file cannot be
+ * read.
+ */
+bool StreamDictionaryBucket(string fileName, int wordLength, DictionaryIngest& ingest) {
+    ingest.fileDescriptor = open(fileName.c_str(), O_RDONLY);
+    if (ingest.fileDescriptor < 0) {
+        cout << "Error reading " << fileName << endl;
+        return false;
+    }
+    ingest.wordLength = wordLength;
+    ingest.bytesRead = 0;
+    ingest.linesRead = 0;
+    ingest.rejectedWords = 0;
+    ingest.duplicateWords = 0;
+    ingest.bucketText = "";
+    ingest.keptWords.slots.clear();
+    ingest.keptWords.count = 0;
+    InitializeIngestQueue(ingest.freeBlocks);
+    InitializeIngestQueue(ingest.validateQueue);
+    InitializeIngestQueue(ingest.keepQueue);
+    ingest.blocks.resize(INGEST_BLOCKS);
+    for (int i = 0; i < INGEST_BLOCKS; i++) {
+        ingest.blocks[i].data.resize(INGEST_BLOCK_BYTES);
+        PushIngestBlock(ingest.freeBlocks, &ingest.blocks[i]);
+    }
+    pthread_t validateThread, keepThread;
+    pthread_create(&validateThread, NULL, ValidateIngestBlocks, &ingest);
+    pthread_create(&keepThread, NULL, KeepIngestedWords, &ingest);
+    
+    string carry;
+    bool endOfFile = false, readFailed = false;
+    while (!endOfFile) {
+        IngestBlock* block = PopIngestBlock(ingest.freeBlocks);
+        copy(carry.begin(), carry.end(), block->data.begin());
+        size_t blockSize = carry.size();
+        while (blockSize < block->data.size()) {
+            ssize_t bytes = read(ingest.fileDescriptor, &block->data[blockSize], block->data.size() - blockSize);
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) {
+                endOfFile = true;
+                readFailed = bytes < 0;
+                break;
+            }
+            blockSize += bytes;
+            ingest.bytesRead += bytes;
+        }
+        
+        /* Hand on whole lines and carry the partial last line over, cut short if it is too long to keep anyway */
+        size_t linesEnd = blockSize;
+        if (!endOfFile) {
+            while (linesEnd > 0 && block->data[linesEnd - 1] != '\n') linesEnd--;
+        }
+        carry.assign(block->data.begin() + linesEnd, block->data.begin() + min(blockSize, linesEnd + MAX_WORD_LENGTH + 2));
+        block->size = linesEnd;
+        PushIngestBlock(ingest.validateQueue, block);
+    }
+    PushIngestBlock(ingest.validateQueue, NULL);
+    pthread_join(validateThread, NULL);
+    pthread_join(keepThread, NULL);
+    close(ingest.fileDescriptor);
+    if (readFailed) cout << "Error reading " << fileName << endl;
+    return !readFailed;
+}
+
+/*
+ * LoadDictionary
+ * Takes in a CompiledDictionary by reference and loads the dictionary into
+ * it: dictionary.bin is mapped when it can be, otherwise the text dictionary
+ * is read and compiled in memory.  openings.bin is mapped alongside it if it
+ * was built from the same dictionary.
+ */
+void LoadDictionary(CompiledDictionary& compiledDictionary) {
+    METRIC_TIMER(loadStart);
+    if (!MapCompiledDictionary(COMPILED_HANGMAN_DICTIONARY, compiledDictionary)) {
+        BuildCompiledDictionary(HANGMAN_DICTIONARY, compiledDictionary.builtData);
+        compiledDictionary.fileData = compiledDictionary.builtData.data();
+        compiledDictionary.fileSize = compiledDictionary.builtData.size();
+    }
+    MapOpeningBook(OPENING_BOOK, compiledDictionary);
+    METRIC_OBSERVE_TIME(METRIC_DICTIONARY_LOAD, loadStart);
+}
+
+/*
+ * MapCompiledDictionary
+ * Takes in the compiled dictionary file name and a CompiledDictionary by reference.
+ * Maps the file read-only into memory and checks its header and length index.
+ * Returns false (leaving nothing mapped) if the file is missing or malformed so
+ * the caller can fall back to the text dictionary.
+ */
+bool MapCompiledDictionary(string compiledFileName, CompiledDictionary& compiledDictionary) {
+    compiledDictionary.fileData = NULL;
+    compiledDictionary.fileSize = 0;
+    compiledDictionary.builtData = "";
+    
+    int fileDescriptor = open(compiledFileName.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) return false;
+    struct stat fileStatus;
+    if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size < (off_t)sizeof(CompiledDictionaryHeader)) {
+        close(fileDescriptor);
+        return false;
+    }
+    size_t fileSize = fileStatus.st_size;
+    void* mapping = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (mapping == MAP_FAILED) return false;
+    
+    const char* fileData = (const char*)mapping;
+    const CompiledDictionaryHeader* header = (const CompiledDictionaryHeader*)fileData;
+    bool valid = memcmp(header->magic, COMPILED_DICTIONARY_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->version == COMPILED_DICTIONARY_VERSION &&
+                 header->fileSize == fileSize &&
+                 sizeof(*header) + (size_t)header->bucketCount * sizeof(CompiledBucketEntry) <= fileSize;
+    for (uint32_t i = 0; valid && i < header->bucketCount; i++) {
+        const CompiledBucketEntry* entry = (const CompiledBucketEntry*)(fileData + sizeof(*header)) + i;
+        valid = entry->wordLength > 0 && entry->wordLength <= MAX_WORD_LENGTH &&
+                entry->wordsOffset + (size_t)entry->wordCount * entry->wordLength <= fileSize;
+    }
+    if (!valid) {
+        munmap(mapping, fileSize);
+        return false;
+    }
+    
+    compiledDictionary.fileData = fileData;
+    compiledDictionary.fileSize = fileSize;
+    return true;
+}
+
+/*
+ * UnmapCompiledDictionary
+ * Releases the mapping made by MapCompiledDictionary or the image built by
+ * LoadDictionary, if any, and the opening book mapped with it.  Word buckets
+ * found in the dictionary must not be used afterwards.
+ */
+void UnmapCompiledDictionary(CompiledDictionary& compiledDictionary) {
+    if (!compiledDictionary.builtData.empty()) {
+        string().swap(compiledDictionary.builtData);
+    } else if (compiledDictionary.fileData != NULL) {
+        munmap((void*)compiledDictionary.fileData, compiledDictionary.fileSize);
+    }
+    if (compiledDictionary.bookData != NULL) {
+        munmap((void*)compiledDictionary.bookData, compiledDictionary.bookSize);
+    }
+    compiledDictionary.fileData = NULL;
+    compiledDictionary.fileSize = 0;
+    compiledDictionary.bookData = NULL;
+    compiledDictionary.bookSize = 0;
+}
+
+/*
+ * GetDictionaryChecksum
+ * Returns the 64-bit FNV-1a hash of a loaded compiled dictionary's image,
+ * which the text and the compiled form of one dictionary share, so that an
+ * opening book can tell whether it was built from the loaded dictionary.
+ */
+uint64_t GetDictionaryChecksum(CompiledDictionary& compiledDictionary) {
+    return HashBytes(compiledDictionary.fileData, compiledDictionary.fileSize);
+}
+
+/*
+ * HashBytes
+ * Returns the 64-bit FNV-1a hash of byteCount bytes.
+ */
+uint64_t HashBytes(const char* bytes, size_t byteCount) {
+    uint64_t checksum = 14695981039346656037ULL;
+    for (size_t i = 0; i < byteCount; i++) {
+        checksum = (checksum ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+    }
+    return checksum;
+}
+
+/*
+ * BuildOpeningBook
+ * Takes in the text dictionary file name and the opening book file name.
+ * Reads the text dictionary and, for every word length, plays every one and
+ * two letter opening on a new game with FindLargestWordFamily, writing the
+ * results out in the format described at OpeningBookHeader.  Returns false if
+ * either file cannot be used.
+ */
+bool BuildOpeningBook(string dictionaryFileName, string bookFileName) {
+    CompiledDictionary compiledDictionary;
+    if (!BuildCompiledDictionary(dictionaryFileName, compiledDictionary.builtData)) return false;
+    compiledDictionary.fileData = compiledDictionary.builtData.data();
+    compiledDictionary.fileSize = compiledDictionary.builtData.size();
+    compiledDictionary.bookData = NULL;
+    compiledDictionary.bookSize = 0;
+    
+    vector<OpeningBookEntry> entries((MAX_WORD_LENGTH + 1) * OPENING_BOOK_TABLE_ENTRIES);
+    PartitionScratch partitionScratch;
+    vector<int> openingWords, secondWords;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        WordBucket wordBucket;
+        FindCompiledWordBucket(compiledDictionary, wordLength, wordBucket);
+        if (wordBucket.wordCount == 0) continue;
+        OpeningBookEntry* table = &entries[wordLength * OPENING_BOOK_TABLE_ENTRIES];
+        for (size_t first = 0; first < ALPHABET.size(); first++) {
+            InitializePossibleWordIndices(wordBucket, openingWords);
+            unsigned int firstFamilyKey = FindLargestWordFamily(ALPHABET[first], wordBucket, openingWords, partitionScratch);
+            OpeningBookEntry openingEntry = {firstFamilyKey, 0, (uint32_t)openingWords.size()};
+            table[first * ALPHABET.size() + first] = openingEntry;
+            for (size_t second = 0; second < ALPHABET.size(); second++) {
+                if (second == first) continue;
+                secondWords = openingWords;
+                unsigned int secondFamilyKey = FindLargestWordFamily(ALPHABET[second], wordBucket, secondWords, partitionScratch);
+                OpeningBookEntry secondEntry = {firstFamilyKey, secondFamilyKey, (uint32_t)secondWords.size()};
+                table[first * ALPHABET.size() + second] = secondEntry;
+            }
+        }
+    }
+    
+    OpeningBookHeader header;
+    memcpy(header.magic, OPENING_BOOK_MAGIC, sizeof(header.magic));
+    header.version = OPENING_BOOK_VERSION;
+    header.dictionaryChecksum = GetDictionaryChecksum(compiledDictionary);
+    header.fileSize = (uint32_t)(sizeof(header) + entries.size() * sizeof(OpeningBookEntry));
+    header.reserved = 0;
+    ofstream bookFile(bookFileName.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!bookFile.is_open()) {
+        cout << "Error writing " << bookFileName << endl;
+        return false;
+    }
+    bookFile.write((const char*)&header, sizeof(header));
+    bookFile.write((const char*)&entries[0], entries.size() * sizeof(OpeningBookEntry));
+    return bookFile.good();
+}
+
+/*
+ * MapOpeningBook
+ * Takes in the opening book file name and a loaded CompiledDictionary by
+ * reference.  Maps the book read-only into memory and checks its header.
+ * Returns false (leaving nothing mapped) if the file is missing or malformed,
+ * or was built from another dictionary, in which case it says so.
+ */
+bool MapOpeningBook(string bookFileName, CompiledDictionary& compiledDictionary) {
+    compiledDictionary.bookData = NULL;
+    compiledDictionary.bookSize = 0;
+    
+    int fileDescriptor = open(bookFileName.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) return false;
+    size_t bookSize = sizeof(OpeningBookHeader) + (MAX_WORD_LENGTH + 1) * OPENING_BOOK_TABLE_ENTRIES * sizeof(OpeningBookEntry);
+    struct stat fileStatus;
+    if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size != (off_t)bookSize) {
+        close(fileDescriptor);
+        return false;
+    }
+    void* mapping = mmap(NULL, bookSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (mapping == MAP_FAILED) return false;
+    
+    const OpeningBookHeader* header = (const OpeningBookHeader*)mapping;
+    if (memcmp(header->magic, OPENING_BOOK_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != OPENING_BOOK_VERSION || header->fileSize != bookSize) {
+        munmap(mapping, bookSize);
+        return false;
+    }
+    if (header->dictionaryChecksum != GetDictionaryChecksum(compiledDictionary)) {
+        cerr << bookFileName << " was built from another dictionary and is ignored" << endl;
+        munmap(mapping, bookSize);
+        return false;
+    }
+    
+    compiledDictionary.bookData = (const char*)mapping;
+    compiledDictionary.bookSize = bookSize;
+    return true;
+}
+
+/*
+ * ReadCompiledWordLengths
+ * Takes in a loaded compiled dictionary and an integer set by reference and
+ * inserts every word length listed in the dictionary's length index.
+ */
+void ReadCompiledWordLengths(CompiledDictionary& compiledDictionary, set<int>& wordLengths) {
+    const CompiledDictionaryHeader* header = (const CompiledDictionaryHeader*)compiledDictionary.fileData;
+    const CompiledBucketEntry* entries = (const CompiledBucketEntry*)(compiledDictionary.fileData + sizeof(*header));
+    for (uint32_t i = 0; i < header->bucketCount; i++) {
+        wordLengths.insert((int)entries[i].wordLength);
+    }
+}
+
+/*
+ * FindCompiledWordBucket
+ * Takes in a loaded compiled dictionary, a word length and a word bucket by
+ * reference.  Points the bucket at the length's words inside the dictionary
+ * without copying them, and at the length's opening book table if there is
+ * a book.  The bucket is left empty if no words have the length.
+ */
+void FindCompiledWordBucket(CompiledDictionary& compiledDictionary, int wordLength, WordBucket& wordBucket) {
+    const CompiledDictionaryHeader* header = (const CompiledDictionaryHeader*)compiledDictionary.fileData;
+    const CompiledBucketEntry* entries = (const CompiledBucketEntry*)(compiledDictionary.fileData + sizeof(*header));
+    wordBucket.wordLength = wordLength;
+    wordBucket.wordCount = 0;
+    wordBucket.words = NULL;
+    for (uint32_t i = 0; i < header->bucketCount; i++) {
+        if (entries[i].wordLength == (uint32_t)wordLength) {
+            wordBucket.wordCount = entries[i].wordCount;
+            wordBucket.words = compiledDictionary.fileData + entries[i].wordsOffset;
+        }
+    }
+    wordBucket.wordsChecksum = HashBytes(wordBucket.words, (size_t)wordBucket.wordCount * wordLength);
+    wordBucket.openingBook = NULL;
+    if (compiledDictionary.bookData != NULL) {
+        wordBucket.openingBook = (const OpeningBookEntry*)(compiledDictionary.bookData + sizeof(OpeningBookHeader)) +
+                                 wordLength * OPENING_BOOK_TABLE_ENTRIES;
+    }
+    BuildLetterMaskIndex(wordBucket);
+    BuildLetterBitIndex(wordBucket);
+}
+
+/*
+ * MakeGuessedWord
+ * Takes in a an integer word length by value and string by reference and
+ * converts the string into a string of a number of "_" (underscore) characters
+ * equal to the word length.
+ */
+void InitializeGuessedWord(int wordLength, string& guessedWord) {
+    string result = "";
+    for (size_t i = 0; i < wordLength; i++) {
+        result += "_";
+    }
+    guessedWord = result;
+    
+}
+
+/*
+ * InitializePossibleWordIndices
+ * Takes in a word bucket and a vector of possible word indices by reference
+ * and sets possibleWords to the index of every word in the bucket.
+ */
+void InitializePossibleWordIndices(WordBucket& wordBucket, vector<int>& possibleWords) {
+    possibleWords.resize(wordBucket.wordCount);
+    for (int i = 0; i < wordBucket.wordCount; i++) {
+        possibleWords[i] = i;
+    }
+}
+
+/*
+ * GetBucketWord
+ * Takes in a word bucket by reference and a word index and returns a pointer
+ * to the first of the word's wordLength characters.  The word is not null
+ * terminated.
+ */
+const char* GetBucketWord(WordBucket& wordBucket, int wordIndex) {
+    return wordBucket.words + (size_t)wordIndex * wordBucket.wordLength;
+}
+
+/*
+ * BuildLetterMaskIndex
+ * Takes in a word bucket by reference and fills its letterMasks index in one
+ * pass over the words: each character sets its position's bit in the column
+ * of its letter.  Characters outside a-z are left out of the index.  (This is
+ * faster than running a family mask kernel once per letter, since each word
+ * is visited once rather than 26 times.)  The pass is the bucket length's
+ * unrolled kernel.
+ */
+void BuildLetterMaskIndex(WordBucket& wordBucket) {
+    wordBucket.letterMasks.assign(ALPHABET.size() * (size_t)wordBucket.wordCount, 0);
+    if (wordBucket.wordCount == 0) return;
+    WORD_LENGTH_KERNELS[wordBucket.wordLength].addLetterMasks(wordBucket.words, wordBucket.wordCount, &wordBucket.letterMasks[0]);
+}
+
+/*
+ * AddLetterMasksGeneric
+ * The pass of BuildLetterMaskIndex for any word length, the reference the
+ * unrolled kernels must agree with: sets the bits of wordCount packed words
+ * in letterMasks, a column of wordCount masks per letter.
+ */
+void AddLetterMasksGeneric(const char* words, int wordLength, int wordCount, unsigned int* letterMasks) {
+    for (int i = 0; i < wordCount; i++) {
+        const char* word = words + (size_t)i * wordLength;
+        for (int j = 0; j < wordLength; j++) {
+            if (word[j] >= 'a' && word[j] <= 'z') {
+                letterMasks[(word[j] - 'a') * (size_t)wordCount + i] |= 1u << j;
+            }
+        }
+    }
+}
+
+/*
+ * GetLetterMaskColumn
+ * Returns the letterMasks column holding every word's family key for the
+ * guess char, or NULL if the guess char is not a letter in the index.
+ */
+const unsigned int* GetLetterMaskColumn(WordBucket& wordBucket, char guessChar) {
+    if (guessChar < 'a' || guessChar > 'z' || wordBucket.wordCount == 0) return NULL;
+    return &wordBucket.letterMasks[(guessChar - 'a') * (size_t)wordBucket.wordCount];
+}
+
+/*
+ * BuildLetterBitIndex
+ * Takes in a word bucket by reference and fills its letterBits index in one
+ * pass over the words, like BuildLetterMaskIndex: each character sets word
+ * i's bit in the row of its letter and position and in the letter's row for
+ * anywhere in the word.
+ */
+void BuildLetterBitIndex(WordBucket& wordBucket) {
+    wordBucket.blockCount = (wordBucket.wordCount + 63) / 64;
+    wordBucket.letterBits.assign(ALPHABET.size() * (wordBucket.wordLength + 1) * wordBucket.blockCount, 0);
+    if (wordBucket.wordCount == 0) return;
+    WORD_LENGTH_KERNELS[wordBucket.wordLength].addLetterBits(wordBucket.words, wordBucket.wordCount, wordBucket.blockCount, &wordBucket.letterBits[0]);
+}
+
+/*
+ * AddLetterBitsGeneric
+ * The pass of BuildLetterBitIndex for any word length, the reference the
+ * unrolled kernels must agree with.
+ */
+void AddLetterBitsGeneric(const char* words, int wordLength, int wordCount, int blockCount, uint64_t* letterBits) {
+    for (int i = 0; i < wordCount; i++) {
+        const char* word = words + (size_t)i * wordLength;
+        uint64_t wordBit = (uint64_t)1 << (i % 64);
+        for (int j = 0; j < wordLength; j++) {
+            if (word[j] >= 'a' && word[j] <= 'z') {
+                uint64_t* positionRow = &letterBits[((word[j] - 'a') * (wordLength + 1) + j) * (size_t)blockCount];
+                uint64_t* anywhereRow = positionRow + (wordLength - j) * (size_t)blockCount;
+                positionRow[i / 64] |= wordBit;
+                anywhereRow[i / 64] |= wordBit;
+            }
+        }
+    }
+}
+
+/*
+ * GetLetterBitRow
+ * Returns the letterBits row of the words with the letter at the position,
+ * or anywhere when the position is wordLength.  The letter must be a-z.
+ */
+const uint64_t* GetLetterBitRow(WordBucket& wordBucket, char letter, int position) {
+    return &wordBucket.letterBits[((letter - 'a') * (wordBucket.wordLength + 1) + position) * (size_t)wordBucket.blockCount];
+}
+
+/*
+ * InitializeCandidateBits
+ * Takes in a word bucket and a candidate pool by reference and sets the pool
+ * to every word in the bucket, the bitset counterpart of
+ * InitializePossibleWordIndices.
+ */
+void InitializeCandidateBits(WordBucket& wordBucket, CandidateBits& candidateBits) {
+    candidateBits.blocks.assign(wordBucket.blockCount, ~(uint64_t)0);
+    if (wordBucket.wordCount % 64 != 0) {
+        candidateBits.blocks.back() = ((uint64_t)1 << (wordBucket.wordCount % 64)) - 1;
+    }
+    candidateBits.firstBlock = 0;
+    candidateBits.endBlock = wordBucket.blockCount;
+    candidateBits.wordCount = wordBucket.wordCount;
+}
+
+/*
+ * GetFirstCandidate
+ * Returns the bucket index of the first word left in a candidate pool, or -1
+ * if it is empty.
+ */
+int GetFirstCandidate(CandidateBits& candidateBits) {
+    for (int i = candidateBits.firstBlock; i < candidateBits.endBlock; i++) {
+        if (candidateBits.blocks[i] != 0) {
+            return (int)(i * 64 + __builtin_ctzll(candidateBits.blocks[i]));
+        }
+    }
+    return -1;
+}
+
+/*
+ * ListCandidateBits
+ * Takes in a candidate pool and a vector of possible word indices by
+ * reference and sets possibleWords to the pool's words in bucket order.
+ */
+void ListCandidateBits(CandidateBits& candidateBits, vector<int>& possibleWords) {
+    possibleWords.clear();
+    for (int i = candidateBits.firstBlock; i < candidateBits.endBlock; i++) {
+        for (uint64_t bits = candidateBits.blocks[i]; bits != 0; bits &= bits - 1) {
+            possibleWords.push_back((int)(i * 64 + __builtin_ctzll(bits)));
+        }
+    }
+}
+
+/*
+ * SetCandidateBits
+ * Takes in a word bucket, a vector of possible word indices and a candidate
+ * pool by reference and sets the pool to the words in possibleWords.
+ */
+void SetCandidateBits(WordBucket& wordBucket, vector<int>& possibleWords, CandidateBits& candidateBits) {
+    candidateBits.blocks.assign(wordBucket.blockCount, 0);
+    for (size_t i = 0; i < possibleWords.size(); i++) {
+        candidateBits.blocks[possibleWords[i] / 64] |= (uint64_t)1 << (possibleWords[i] % 64);
+    }
+    candidateBits.firstBlock = possibleWords.empty() ? 0 : possibleWords.front() / 64;
+    candidateBits.endBlock = possibleWords.empty() ? 0 : possibleWords.back() / 64 + 1;
+    candidateBits.wordCount = (int)possibleWords.size();
+}
+
+/*
+ * MakeFamilyKey
+ * Takes in a word of wordLength characters and a guess character and returns
+ * the word's family as a positional bitmask: bit i is set when the character
+ * at position i is the guess char.  For instance, with guess char 'e'
+ * "else" -> e__e -> 1001 (bits 0 and 3).  Turns read keys from the bucket's
+ * letter mask index instead and only fall back to this for other characters.
+ */
+unsigned int MakeFamilyKey(const char* word, int wordLength, char guessChar) {
+    unsigned int familyKey = 0;
+    for (int i = 0; i < wordLength; i++) {
+        if (word[i] == guessChar) {
+            familyKey |= 1u << i;
+        }
+    }
+    return familyKey;
+}
+
+/*
+ * AppendFamilyKeyBits
+ * Takes in a family key stream and the next bitCount match bits of the
+ * bucket's byte matrix (bit 0 first) and writes out a family key for every
+ * word whose bits are now complete.  bitCount is at most 32, and fewer than
+ * wordLength bits are ever left over, so the stream's 64 bits never overflow.
+ */
+inline void AppendFamilyKeyBits(FamilyKeyStream& familyKeyStream, unsigned int matchBits, int bitCount) {
+    familyKeyStream.bits |= (uint64_t)matchBits << familyKeyStream.bitCount;
+    familyKeyStream.bitCount += bitCount;
+    while (familyKeyStream.bitCount >= familyKeyStream.wordLength) {
+        *familyKeyStream.nextFamilyKey++ = (unsigned int)(familyKeyStream.bits & familyKeyStream.keyMask);
+        familyKeyStream.bits >>= familyKeyStream.wordLength;
+        familyKeyStream.bitCount -= familyKeyStream.wordLength;
+    }
+}
+
+/*
+ * AppendFamilyKeyTail
+ * Finishes a family key stream with the bytes from byteOffset to byteCount
+ * (fewer than 32), compared one at a time so no kernel reads past the bucket.
+ */
+inline void AppendFamilyKeyTail(FamilyKeyStream& familyKeyStream, const char* words, size_t byteOffset, size_t byteCount, char guessChar) {
+    unsigned int matchBits = 0;
+    for (size_t i = byteOffset; i < byteCount; i++) {
+        if (words[i] == guessChar) matchBits |= 1u << (i - byteOffset);
+    }
+    AppendFamilyKeyBits(familyKeyStream, matchBits, (int)(byteCount - byteOffset));
+}
+
+/*
+ * InitializeFamilyKeyStream
+ * Sets up a family key stream writing keys of wordLength bits to familyKeys.
+ */
+inline void InitializeFamilyKeyStream(FamilyKeyStream& familyKeyStream, int wordLength, unsigned int* familyKeys) {
+    familyKeyStream.bits = 0;
+    familyKeyStream.bitCount = 0;
+    familyKeyStream.wordLength = wordLength;
+    familyKeyStream.keyMask = ((uint64_t)1 << wordLength) - 1;
+    familyKeyStream.nextFamilyKey = familyKeys;
+}
+
+/*
+ * MakeBucketFamilyKeysScalar
+ * Family mask kernel that works a word at a time with MakeFamilyKey.  It is
+ * the reference the vector kernels must agree with.
+ */
+void MakeBucketFamilyKeysScalar(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys) {
+    for (int i = 0; i < wordCount; i++) {
+        familyKeys[i] = MakeFamilyKey(words + (size_t)i * wordLength, wordLength, guessChar);
+    }
+}
+
+/*
+ * UnrolledWord
+ * The loops of the word length kernels, written as a recursion on Position
+ * (the number of characters still to visit) so the compiler unrolls them
+ * fully for a fixed word length.  Each visits the characters in order.
+ */
+template <int Position>
+struct UnrolledWord {
+    static inline unsigned int MakeFamilyKey(const char* word, char guessChar) {
+        return UnrolledWord<Position - 1>::MakeFamilyKey(word, guessChar) |
+               (unsigned int)(word[Position - 1] == guessChar) << (Position - 1);
+    }
+    static inline void AddLetterMasks(const char* word, unsigned int* letterMasks, size_t columnSize) {
+        UnrolledWord<Position - 1>::AddLetterMasks(word, letterMasks, columnSize);
+        unsigned int letter = (unsigned int)(word[Position - 1] - 'a');
+        if (letter < 26) letterMasks[letter * columnSize] |= 1u << (Position - 1);
+    }
+    static inline void AddLetterBits(const char* word, int wordLength, uint64_t* letterBits, size_t rowSize, uint64_t wordBit) {
+        UnrolledWord<Position - 1>::AddLetterBits(word, wordLength, letterBits, rowSize, wordBit);
+        unsigned int letter = (unsigned int)(word[Position - 1] - 'a');
+        if (letter < 26) {
+            uint64_t* positionRow = letterBits + (letter * (wordLength + 1) + Position - 1) * rowSize;
+            positionRow[0] |= wordBit;
+            positionRow[(wordLength - Position + 1) * rowSize] |= wordBit;
+        }
+    }
+    static inline void RevealFamily(unsigned int familyKey, char* pattern, char guessChar) {
+        UnrolledWord<Position - 1>::RevealFamily(familyKey, pattern, guessChar);
+        if (familyKey & 1u << (Position - 1)) pattern[Position - 1] = guessChar;
+    }
+    static inline bool HasBlank(const char* pattern) {
+        return UnrolledWord<Position - 1>::HasBlank(pattern) || pattern[Position - 1] == '_';
+    }
+};
+
+template <>
+struct UnrolledWord<0> {
+    static inline unsigned int MakeFamilyKey(const char* /* word */, char /* guessChar */) { return 0; }
+    static inline void AddLetterMasks(const char* /* word */, unsigned int* /* letterMasks */, size_t /* columnSize */) {}
+    static inline void AddLetterBits(const char* /* word */, int /* wordLength */, uint64_t* /* letterBits */, size_t /* rowSize */, uint64_t /* wordBit */) {}
+    static inline void RevealFamily(unsigned int /* familyKey */, char* /* pattern */, char /* guessChar */) {}
+    static inline bool HasBlank(const char* /* pattern */) { return false; }
+};
+
+/*
+ * MakeLengthFamilyKeys, AddLengthLetterMasks, AddLengthLetterBits,
+ * RevealLengthFamily, HasLengthBlank
+ * The word length kernels for words of Length characters (see
+ * WordLengthKernels).  Each agrees with the generic function it stands in
+ * for: MakeBucketFamilyKeysScalar, AddLetterMasksGeneric,
+ * AddLetterBitsGeneric, RevealFamilyGeneric and HasBlankGeneric.
+ */
+template <int Length>
+void MakeLengthFamilyKeys(const char* words, int wordCount, char guessChar, unsigned int* familyKeys) {
+    for (int i = 0; i < wordCount; i++) {
+        familyKeys[i] = UnrolledWord<Length>::MakeFamilyKey(words + (size_t)i * Length, guessChar);
+    }
+}
+
+template <int Length>
+void AddLengthLetterMasks(const char* words, int wordCount, unsigned int* letterMasks) {
+    for (int i = 0; i < wordCount; i++) {
+        UnrolledWord<Length>::AddLetterMasks(words + (size_t)i * Length, letterMasks + i, wordCount);
+    }
+}
+
+template <int Length>
+void AddLengthLetterBits(const char* words, int wordCount, int blockCount, uint64_t* letterBits) {
+    for (int i = 0; i < wordCount; i++) {
+        UnrolledWord<Length>::AddLetterBits(words + (size_t)i * Length, Length, letterBits + i / 64, blockCount, (uint64_t)1 << (i % 64));
+    }
+}
+
+template <int Length>
+void RevealLengthFamily(unsigned int familyKey, char* pattern, char guessChar) {
+    UnrolledWord<Length>::RevealFamily(familyKey, pattern, guessChar);
+}
+
+template <int Length>
+bool HasLengthBlank(const char* pattern) {
+    return UnrolledWord<Length>::HasBlank(pattern);
+}
+
+/*
+ * MakeBucketFamilyKeysUnrolled
+ * Family mask kernel that runs the bucket length's unrolled word length
+ * kernel.
+ */
+void MakeBucketFamilyKeysUnrolled(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys) {
+    WORD_LENGTH_KERNELS[wordLength].makeFamilyKeys(words, wordCount, guessChar, familyKeys);
+}
+
+#ifdef HAVE_X86_FAMILY_MASK_KERNELS
+/*
+ * MakeBucketFamilyKeysSSE2
+ * Family mask kernel that treats the bucket as one byte matrix, compares 16
+ * bytes at a time against the broadcast guess char and gathers the match
+ * bits with movemask, 32 bits per step.
+ */
+__attribute__((target("sse2")))
+void MakeBucketFamilyKeysSSE2(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys) {
+    FamilyKeyStream familyKeyStream;
+    InitializeFamilyKeyStream(familyKeyStream, wordLength, familyKeys);
+    size_t byteCount = (size_t)wordLength * wordCount;
+    size_t blockBytes = byteCount & ~(size_t)31;
+    __m128i guessBytes = _mm_set1_epi8(guessChar);
+    for (size_t offset = 0; offset < blockBytes; offset += 32) {
+        __m128i lowBytes = _mm_loadu_si128((const __m128i*)(words + offset));
+        __m128i highBytes = _mm_loadu_si128((const __m128i*)(words + offset + 16));
+        unsigned int matchBits = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(lowBytes, guessBytes)) |
+                                 (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(highBytes, guessBytes)) << 16;
+        AppendFamilyKeyBits(familyKeyStream, matchBits, 32);
+    }
+    AppendFamilyKeyTail(familyKeyStream, words, blockBytes, byteCount, guessChar);
+}
+
+/*
+ * MakeBucketFamilyKeysAVX2
+ * The AVX2 version of MakeBucketFamilyKeysSSE2, comparing 32 bytes at once.
+ */
+__attribute__((target("avx2")))
+void MakeBucketFamilyKeysAVX2(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys) {
+    FamilyKeyStream familyKeyStream;
+    InitializeFamilyKeyStream(familyKeyStream, wordLength, familyKeys);
+    size_t byteCount = (size_t)wordLength * wordCount;
+    size_t blockBytes = byteCount & ~(size_t)31;
+    __m256i guessBytes = _mm256_set1_epi8(guessChar);
+    for (size_t offset = 0; offset < blockBytes; offset += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(words + offset));
+        AppendFamilyKeyBits(familyKeyStream, (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, guessBytes)), 32);
+    }
+    AppendFamilyKeyTail(familyKeyStream, words, blockBytes, byteCount, guessChar);
+}
+#endif
+
+/*
+ * GetSupportedFamilyMaskKernels
+ * Returns the family mask kernels this processor can run, slowest first.
+ */
+vector<FamilyMaskKernel> GetSupportedFamilyMaskKernels() {
+    vector<FamilyMaskKernel> kernels;
+    FamilyMaskKernel scalarKernel = {"scalar", MakeBucketFamilyKeysScalar};
+    kernels.push_back(scalarKernel);
+    FamilyMaskKernel unrolledKernel = {"unrolled", MakeBucketFamilyKeysUnrolled};
+    kernels.push_back(unrolledKernel);
+#ifdef HAVE_X86_FAMILY_MASK_KERNELS
+    if (__builtin_cpu_supports("sse2")) {
+        FamilyMaskKernel sse2Kernel = {"sse2", MakeBucketFamilyKeysSSE2};
+        kernels.push_back(sse2Kernel);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        FamilyMaskKernel avx2Kernel = {"avx2", MakeBucketFamilyKeysAVX2};
+        kernels.push_back(avx2Kernel);
+    }
+#endif
+    return kernels;
+}
+
+/*
+ * SelectFamilyMaskKernel
+ * Returns the fastest family mask kernel this processor can run.
+ */
+FamilyMaskFunction SelectFamilyMaskKernel() {
+#ifdef HAVE_X86_FAMILY_MASK_KERNELS
+    if (__builtin_cpu_supports("avx2")) return MakeBucketFamilyKeysAVX2;
+    if (__builtin_cpu_supports("sse2")) return MakeBucketFamilyKeysSSE2;
+#endif
+    return MakeBucketFamilyKeysScalar;
+}
+
+/*
+ * MakeWordFamilyKeys
+ * Takes in the word bucket and possible word indices by reference for efficiency
+ * and a guess character.  Fills familyKeys (with room for the whole pool) so
+ * that familyKeys[i] is the family key of the word at possibleWords[i], looked
+ * up in the letter mask index.  Characters outside the index are matched by
+ * the family mask kernel when the pool is still the whole bucket and a word at
+ * a time otherwise.
+ */
+void MakeWordFamilyKeys(WordBucket& wordBucket, vector<int>& possibleWords, char guessChar, unsigned int* familyKeys) {
+    const unsigned int* letterMaskColumn = GetLetterMaskColumn(wordBucket, guessChar);
+    if (letterMaskColumn != NULL) {
+        for (size_t i = 0; i < possibleWords.size(); i++) {
+            familyKeys[i] = letterMaskColumn[possibleWords[i]];
+        }
+        return;
+    }
+    if (!possibleWords.empty() && possibleWords.size() == (size_t)wordBucket.wordCount) {
+        SelectFamilyMaskKernel()(wordBucket.words, wordBucket.wordLength, wordBucket.wordCount, guessChar, familyKeys);
+        return;
+    }
+    for (size_t i = 0; i < possibleWords.size(); i++) {
+        familyKeys[i] = MakeFamilyKey(GetBucketWord(wordBucket, possibleWords[i]), wordBucket.wordLength, guessChar);
+    }
+}
+
+/*
+ * IsFamilyKeyBefore
+ * Returns true if the first family's pattern sorts before the second's when
+ * written out as a string such as "e__e".  Blanks sort before letters, so the
+ * key without a bit at the lowest differing position comes first.  This keeps
+ * ties between equally large families broken the same way as a string map.
+ */
+bool IsFamilyKeyBefore(unsigned int familyKey, unsigned int otherFamilyKey) {
+    unsigned int difference = familyKey ^ otherFamilyKey;
+    unsigned int lowestDifference = difference & (~difference + 1);
+    return difference != 0 && (familyKey & lowestDifference) == 0;
+}
+
+/*
+ * ResetScratchArena
+ * Releases everything carved from the arena and makes sure it holds at least
+ * capacity bytes.  Only allocates when the arena has to grow.
+ */
+void ResetScratchArena(ScratchArena& scratchArena, size_t capacity) {
+    if (scratchArena.memory.size() < capacity) scratchArena.memory.resize(capacity);
+    scratchArena.used = 0;
+}
+
+/*
+ * AllocateScratch
+ * Carves bytes from the arena on a SCRATCH_ALIGNMENT boundary.  Callers size
+ * the arena for everything they carve when they reset it, so running out is a
+ * bug and ends the program.
+ */
+void* AllocateScratch(ScratchArena& scratchArena, size_t bytes) {
+    char* base = scratchArena.memory.empty() ? NULL : &scratchArena.memory[0];
+    size_t offset = scratchArena.used + (size_t)(-(uintptr_t)(base + scratchArena.used) & (SCRATCH_ALIGNMENT - 1));
+    if (offset + bytes > scratchArena.memory.size()) {
+        cerr << "Scratch arena of " << scratchArena.memory.size() << " bytes exhausted" << endl;
+        abort();
+    }
+    scratchArena.used = offset + bytes;
+    return base + offset;
+}
+
+/*
+ * GetFamilyTableSlots
+ * Returns the number of slots a family table for keyCount keys has: the
+ * smallest power of two at least twice keyCount.
+ */
+size_t GetFamilyTableSlots(size_t keyCount) {
+    size_t slotCount = 2;
+    while (slotCount < 2 * keyCount) slotCount *= 2;
+    return slotCount;
+}
+
+/*
+ * AllocateFamilyTable, ClearFamilyTable
+ * AllocateFamilyTable carves the slots for a table of keyCount keys from the
+ * arena, at a size that keeps the table at most half full.  ClearFamilyTable
+ * empties it.  InitializeFamilyTable does both.
+ */
+void AllocateFamilyTable(FamilyTable& familyTable, size_t keyCount, ScratchArena& scratchArena) {
+    familyTable.slotCount = GetFamilyTableSlots(keyCount);
+    familyTable.tableBits = 1;
+    while (((size_t)1 << familyTable.tableBits) < familyTable.slotCount) familyTable.tableBits++;
+    familyTable.keys = (unsigned int*)AllocateScratch(scratchArena, familyTable.slotCount * sizeof(unsigned int));
+    familyTable.counts = (int*)AllocateScratch(scratchArena, familyTable.slotCount * sizeof(int));
+}
+
+void ClearFamilyTable(FamilyTable& familyTable) {
+    fill(familyTable.keys, familyTable.keys + familyTable.slotCount, EMPTY_FAMILY_KEY);
+    fill(familyTable.counts, familyTable.counts + familyTable.slotCount, 0);
+}
+
+void InitializeFamilyTable(FamilyTable& familyTable, size_t keyCount, ScratchArena& scratchArena) {
+    AllocateFamilyTable(familyTable, keyCount, scratchArena);
+    ClearFamilyTable(familyTable);
+}
+
+/*
+ * FindFamilySlot
+ * Returns the slot holding the family with the given key, claiming an empty
+ * one for it if the family is not in the table yet.
+ */
+inline unsigned int FindFamilySlot(FamilyTable& familyTable, unsigned int familyKey) {
+    unsigned int tableMask = (1u << familyTable.tableBits) - 1;
+    unsigned int slot = (familyKey * 2654435761u) >> (32 - familyTable.tableBits);
+    while (familyTable.keys[slot] != EMPTY_FAMILY_KEY && familyTable.keys[slot] != familyKey) {
+        slot = (slot + 1) & tableMask;
+    }
+    familyTable.keys[slot] = familyKey;
+    return slot;
+}
+
+/*
+ * AddToFamilyTable
+ * Adds count words to the family with the given key.
+ */
+void AddToFamilyTable(FamilyTable& familyTable, unsigned int familyKey, int count) {
+    familyTable.counts[FindFamilySlot(familyTable, familyKey)] += count;
+}
+
+/*
+ * FindLargestFamilyInTable
+ * Returns the key of the family with the most words, breaking ties by
+ * IsFamilyKeyBefore.
+ */
+unsigned int FindLargestFamilyInTable(FamilyTable& familyTable) {
+    unsigned int largestFamilyKey = EMPTY_FAMILY_KEY;
+    int largestFamilySize = 0;
+    for (size_t slot = 0; slot < familyTable.slotCount; slot++) {
+        if (familyTable.counts[slot] > largestFamilySize ||
+            (familyTable.counts[slot] == largestFamilySize && familyTable.counts[slot] > 0 && IsFamilyKeyBefore(familyTable.keys[slot], largestFamilyKey))) {
+            largestFamilyKey = familyTable.keys[slot];
+            largestFamilySize = familyTable.counts[slot];
+        }
+    }
+    return largestFamilyKey;
+}
+
+/*
+ * CountFamilyKeys
+ * Adds keyCount family keys to a family table.  With a deadline (0 for none)
+ * the keys are counted in DEADLINE_COUNT_PASSES interleaved passes and the
+ * count stops at the first pass to start after the deadline, so that the
+ * words counted are an even sample of the pool (of at least one pass) rather
+ * than a stretch of it.  Returns false if the count was cut short.
+ */
+bool CountFamilyKeys(const unsigned int* familyKeys, size_t keyCount, FamilyTable& familyTable, double deadline) {
+    if (deadline == 0) {
+        for (size_t i = 0; i < keyCount; i++) {
+            AddToFamilyTable(familyTable, familyKeys[i], 1);
+        }
+        return true;
+    }
+    for (size_t pass = 0; pass < DEADLINE_COUNT_PASSES; pass++) {
+        if (pass > 0 && GetMicroseconds() > deadline) return false;
+        for (size_t i = pass; i < keyCount; i += DEADLINE_COUNT_PASSES) {
+            AddToFamilyTable(familyTable, familyKeys[i], 1);
+        }
+    }
+    return true;
+}
+
+/*
+ * CountLargestFamily
+ * Takes in the keyCount family keys of the possible words, a family table and
+ * the arena to carve it from by reference and a deadline (or 0), counts the
+ * words in each family in the table with CountFamilyKeys and returns the key
+ * of the largest family counted.  No words are touched or copied.
+ */
+unsigned int CountLargestFamily(const unsigned int* familyKeys, size_t keyCount, FamilyTable& familyTable, ScratchArena& scratchArena, double deadline) {
+    InitializeFamilyTable(familyTable, keyCount, scratchArena);
+    CountFamilyKeys(familyKeys, keyCount, familyTable, deadline);
+    return FindLargestFamilyInTable(familyTable);
+}
+
+/*
+ * CountFamilyChunk
+ * First phase of a parallel partition, run on one thread per chunk.  Makes
+ * the family keys for the chunk's words and counts them in the chunk's own
+ * family table, by CountFamilyKeys if the turn has a deadline.
+ */
+void* CountFamilyChunk(void* chunkPointer) {
+    PartitionChunk& chunk = *(PartitionChunk*)chunkPointer;
+    vector<int>& possibleWords = *chunk.possibleWords;
+    unsigned int* familyKeys = chunk.familyKeys;
+    const unsigned int* letterMaskColumn = GetLetterMaskColumn(*chunk.wordBucket, chunk.guessChar);
+    ClearFamilyTable(chunk.familyTable);
+    for (size_t i = chunk.begin; i < chunk.end; i++) {
+        if (letterMaskColumn != NULL) {
+            familyKeys[i] = letterMaskColumn[possibleWords[i]];
+        } else {
+            familyKeys[i] = MakeFamilyKey(GetBucketWord(*chunk.wordBucket, possibleWords[i]), chunk.wordBucket->wordLength, chunk.guessChar);
+        }
+        if (chunk.deadline == 0) AddToFamilyTable(chunk.familyTable, familyKeys[i], 1);
+    }
+    chunk.countedAll = chunk.deadline == 0 ||
+                       CountFamilyKeys(familyKeys + chunk.begin, chunk.end - chunk.begin, chunk.familyTable, chunk.deadline);
+    return NULL;
+}
+
+/*
+ * ScatterFamilyChunk
+ * Second phase of a parallel partition.  Copies the chunk's members of the
+ * winning family into the narrowed pool, starting at the chunk's offset.
+ */
+void* ScatterFamilyChunk(void* chunkPointer) {
+    PartitionChunk& chunk = *(PartitionChunk*)chunkPointer;
+    vector<int>& possibleWords = *chunk.possibleWords;
+    unsigned int* familyKeys = chunk.familyKeys;
+    int* familyWords = chunk.familyWords;
+    size_t familyIndex = chunk.familyOffset;
+    for (size_t i = chunk.begin; i < chunk.end; i++) {
+        if (familyKeys[i] == chunk.largestFamilyKey) {
+            familyWords[familyIndex++] = possibleWords[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * RunPartitionChunks
+ * Runs chunkMain on every chunk in the scratch space, the first on the calling
+ * thread and the rest on threads of their own, and waits for all of them.
+ */
+void RunPartitionChunks(PartitionScratch& partitionScratch, void* (*chunkMain)(void*)) {
+    vector<PartitionChunk>& chunks = partitionScratch.chunks;
+    vector<pthread_t>& threads = partitionScratch.threads;
+    threads.resize(chunks.size());
+    for (size_t i = 1; i < chunks.size(); i++) {
+        pthread_create(&threads[i], NULL, chunkMain, &chunks[i]);
+    }
+    chunkMain(&chunks[0]);
+    for (size_t i = 1; i < chunks.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/*
+ * GetPartitionScratchBytes
+ * Returns the arena space a turn on a pool of poolSize words carves out when
+ * split into chunkCount chunks (0 for the serial path): the family keys, the
+ * narrowed pool, the merged family table and one table per chunk.
+ */
+size_t GetPartitionScratchBytes(size_t poolSize, int chunkCount) {
+    size_t tableBytes = GetFamilyTableSlots(poolSize) * (sizeof(unsigned int) + sizeof(int));
+    return poolSize * (sizeof(unsigned int) + sizeof(int)) + (chunkCount + 1) * tableBytes +
+           (2 * chunkCount + 4) * SCRATCH_ALIGNMENT;
+}
+
+/*
+ * ReservePartitionScratch
+ * Takes in a partition scratch space by reference and a pool size, resets
+ * the scratch arena and sizes it for everything a turn on a pool that large
+ * (or on any narrower one) carves from it, on both the serial and the
+ * parallel path.  Called by each turn, it only allocates when the scratch
+ * space has not yet seen so large a pool.
+ */
+void ReservePartitionScratch(PartitionScratch& partitionScratch, size_t poolSize) {
+    int chunkCount = partitionThreadCount > 1 && poolSize >= (size_t)parallelPartitionThreshold ? partitionThreadCount : 0;
+    ResetScratchArena(partitionScratch.arena, GetPartitionScratchBytes(poolSize, chunkCount));
+    if (partitionScratch.chunks.size() < (size_t)chunkCount) {
+        partitionScratch.chunks.resize(chunkCount);
+        partitionScratch.threads.reserve(chunkCount);
+    }
+}
+
+/*
+ * FindLargestWordFamilyInParallel
+ * Does the work of FindLargestWordFamily on threadCount threads.  The pool is
+ * split into equal chunks, each thread builds a family histogram for its chunk,
+ * the histograms are merged to pick the winner, and each thread then scatters
+ * its members of the winning family into place.  Gives the same result as the
+ * serial path, including when the deadline (or 0) cuts the count short, in
+ * which case the winning family is gathered on the calling thread since the
+ * chunks do not know how many of its members they hold.
+ */
+unsigned int FindLargestWordFamilyInParallel(char guessChar, WordBucket& wordBucket, vector<int>& possibleWords, PartitionScratch& partitionScratch, int threadCount, double deadline) {
+    ScratchArena& scratchArena = partitionScratch.arena;
+    vector<PartitionChunk>& chunks = partitionScratch.chunks;
+    ResetScratchArena(scratchArena, GetPartitionScratchBytes(possibleWords.size(), threadCount));
+    unsigned int* familyKeys = (unsigned int*)AllocateScratch(scratchArena, possibleWords.size() * sizeof(unsigned int));
+    int* familyWords = (int*)AllocateScratch(scratchArena, possibleWords.size() * sizeof(int));
+    chunks.resize(threadCount);
+    for (int i = 0; i < threadCount; i++) {
+        chunks[i].wordBucket = &wordBucket;
+        chunks[i].possibleWords = &possibleWords;
+        chunks[i].familyKeys = familyKeys;
+        chunks[i].guessChar = guessChar;
+        chunks[i].begin = possibleWords.size() * i / threadCount;
+        chunks[i].end = possibleWords.size() * (i + 1) / threadCount;
+        chunks[i].deadline = deadline;
+        AllocateFamilyTable(chunks[i].familyTable, chunks[i].end - chunks[i].begin, scratchArena);
+    }
+    RunPartitionChunks(partitionScratch, CountFamilyChunk);
+    
+    /* Merge the histograms and find the winner */
+    FamilyTable& familyTable = partitionScratch.familyTable;
+    InitializeFamilyTable(familyTable, possibleWords.size(), scratchArena);
+    for (int i = 0; i < threadCount; i++) {
+        for (size_t slot = 0; slot < chunks[i].familyTable.slotCount; slot++) {
+            if (chunks[i].familyTable.counts[slot] > 0) {
+                AddToFamilyTable(familyTable, chunks[i].familyTable.keys[slot], chunks[i].familyTable.counts[slot]);
+            }
+        }
+    }
+    unsigned int largestFamilyKey = FindLargestFamilyInTable(familyTable);
+    METRIC_OBSERVE(METRIC_FAMILIES_GENERATED, CountFamiliesInTable(familyTable));
+    bool countedAll = true;
+    for (int i = 0; i < threadCount; i++) countedAll = countedAll && chunks[i].countedAll;
+    if (!countedAll) {
+        size_t familySize = 0;
+        for (size_t i = 0; i < possibleWords.size(); i++) {
+            if (familyKeys[i] == largestFamilyKey) possibleWords[familySize++] = possibleWords[i];
+        }
+        possibleWords.resize(familySize);
+        return largestFamilyKey;
+    }
+    
+    /* Give each chunk the offset of its first member of the winning family */
+    size_t familySize = 0;
+    for (int i = 0; i < threadCount; i++) {
+        chunks[i].largestFamilyKey = largestFamilyKey;
+        chunks[i].familyWords = familyWords;
+        chunks[i].familyOffset = familySize;
+        for (size_t slot = 0; slot < chunks[i].familyTable.slotCount; slot++) {
+            if (chunks[i].familyTable.keys[slot] == largestFamilyKey) familySize += chunks[i].familyTable.counts[slot];
+        }
+    }
+    RunPartitionChunks(partitionScratch, ScatterFamilyChunk);
+    copy(familyWords, familyWords + familySize, possibleWords.begin());
+    possibleWords.resize(familySize);
+    return largestFamilyKey;
+}
+
+/*
+ * FindLargestWordFamily
+ * Takes in a character guessed, the word bucket and the possible word indices
+ * by reference.  The function finds the largest family of words which share a
+ * pattern of the character guessed (i.e. one family is words that don't contain
+ * the character guessed.  The second family might have the letter in the first
+ * and third spots, etc.), narrows possibleWords in place to that family's
+ * indices (keeping their order) and returns the family key.  Pools of at least
+ * parallelPartitionThreshold words are split across partitionThreadCount threads.
+ * All working space is carved from partitionScratch's arena, so nothing is
+ * allocated once the scratch space has seen a pool this large.
+ */
+unsigned int FindLargestWordFamily(char guessChar, WordBucket& wordBucket, vector<int>& possibleWords, PartitionScratch& partitionScratch) {
+    return FindLargestWordFamilyByDeadline(guessChar, wordBucket, possibleWords, partitionScratch, 0);
+}
+
+/*
+ * FindLargestWordFamilyByDeadline
+ * FindLargestWordFamily for a turn that must be answered by a deadline (or
+ * 0).  A count still running at the deadline is cut short (see
+ * CountFamilyKeys) and the pool is narrowed to the largest family among the
+ * words counted, which is the largest family of the pool or close to it.
+ */
+unsigned int FindLargestWordFamilyByDeadline(char guessChar, WordBucket& wordBucket, vector<int>& possibleWords, PartitionScratch& partitionScratch, double deadline) {
+    if (partitionThreadCount > 1 && possibleWords.size() >= (size_t)parallelPartitionThreshold) {
+        return FindLargestWordFamilyInParallel(guessChar, wordBucket, possibleWords, partitionScratch, partitionThreadCount, deadline);
+    }
+    ReservePartitionScratch(partitionScratch, possibleWords.size());
+    unsigned int* familyKeys = (unsigned int*)AllocateScratch(partitionScratch.arena, possibleWords.size() * sizeof(unsigned int));
+    METRIC_TIMER(keysStart);
+    MakeWordFamilyKeys(wordBucket, possibleWords, guessChar, familyKeys);
+    METRIC_OBSERVE_TIME(METRIC_MAKE_WORD_FAMILY_KEYS, keysStart);
+    METRIC_TIMER(countStart);
+    unsigned int largestFamilyKey = CountLargestFamily(familyKeys, possibleWords.size(), partitionScratch.familyTable, partitionScratch.arena, deadline);
+    METRIC_OBSERVE_TIME(METRIC_COUNT_LARGEST_FAMILY, countStart);
+    METRIC_OBSERVE(METRIC_FAMILIES_GENERATED, CountFamiliesInTable(partitionScratch.familyTable));
+    
+    size_t familySize = 0;
+    for (size_t i = 0; i < possibleWords.size(); i++) {
+        if (familyKeys[i] == largestFamilyKey) {
+            possibleWords[familySize++] = possibleWords[i];
+        }
+    }
+    possibleWords.resize(familySize);
+    return largestFamilyKey;
+}
+    
+    /*
+     ***** Implementation notes *****
+     make a family key for each possible word
+        set bit i when position i holds the guess char
+     count the keys in a flat open addressed table
+     
+     Iterate over the table and find the largest count
+     Compact the possible word indices down to that family
+     */
+
+/*
+ * FindOpeningBookEntry
+ * Returns the opening book entry for playing guessChar on a pool of poolSize
+ * words with the pattern guessedWord, or NULL if the bucket has no book or
+ * the pool is not one the book covers: the whole bucket before any guess, or
+ * the book's family for the one letter guessed, as told by the positions of
+ * that letter in the pattern.
+ */
+const OpeningBookEntry* FindOpeningBookEntry(WordBucket& wordBucket, size_t poolSize, string& guessedWord, string& charactersGuessed, char guessChar) {
+    if (wordBucket.openingBook == NULL || guessChar < 'a' || guessChar > 'z' || charactersGuessed.size() > 1) return NULL;
+    size_t second = guessChar - 'a';
+    if (charactersGuessed.empty()) {
+        if (poolSize != (size_t)wordBucket.wordCount) return NULL;
+        return &wordBucket.openingBook[second * ALPHABET.size() + second];
+    }
+    char firstChar = charactersGuessed[0];
+    if (firstChar < 'a' || firstChar > 'z' || firstChar == guessChar) return NULL;
+    size_t first = firstChar - 'a';
+    unsigned int firstFamilyKey = MakeFamilyKey(guessedWord.data(), (int)guessedWord.size(), firstChar);
+    if (firstFamilyKey != wordBucket.openingBook[first * ALPHABET.size() + first].firstFamilyKey) return NULL;
+    return &wordBucket.openingBook[first * ALPHABET.size() + second];
+}
+
+/*
+ * NarrowToWordFamily
+ * Narrows possibleWords in place, keeping their order, to the words in the
+ * family with the given key for the guess char.  This is the second half of
+ * FindLargestWordFamily, for when the family is already known.
+ */
+void NarrowToWordFamily(WordBucket& wordBucket, vector<int>& possibleWords, char guessChar, unsigned int familyKey) {
+    const unsigned int* letterMaskColumn = GetLetterMaskColumn(wordBucket, guessChar);
+    size_t familySize = 0;
+    for (size_t i = 0; i < possibleWords.size(); i++) {
+        if (letterMaskColumn[possibleWords[i]] == familyKey) {
+            possibleWords[familySize++] = possibleWords[i];
+        }
+    }
+    possibleWords.resize(familySize);
+}
+
+/*
+ * ChooseLargestWordFamily
+ * The greedy strategy: FindLargestWordFamily, which looks no further than
+ * the guess being played, cut short by the turn's deadline.  The first two
+ * guesses of a game are looked up in the opening book instead when there is
+ * one, which saves counting the families of the largest pools.
+ */
+unsigned int ChooseLargestWordFamily(char guessChar, WordBucket& wordBucket, vector<int>& possibleWords, string& guessedWord, string& charactersGuessed, PartitionScratch& partitionScratch) {
+    const OpeningBookEntry* openingEntry = FindOpeningBookEntry(wordBucket, possibleWords.size(), guessedWord, charactersGuessed, guessChar);
+    if (openingEntry != NULL) {
+        unsigned int familyKey = charactersGuessed.empty() ? openingEntry->firstFamilyKey : openingEntry->secondFamilyKey;
+        NarrowToWordFamily(wordBucket, possibleWords, guessChar, familyKey);
+        return familyKey;
+    }
+    return FindLargestWordFamilyByDeadline(guessChar, wordBucket, possibleWords, partitionScratch, partitionScratch.turnDeadline);
+}
+
+/*
+ * FindSampledWordFamily
+ * The approximate counterpart of FindLargestWordFamily, with the same
+ * contract.  Pools of at least SAMPLED_FAMILY_MIN_POOL words have their
+ * family sizes estimated from words drawn at random, the sample doubling
+ * from SAMPLED_FAMILY_FIRST_SAMPLE until its largest family leads the next
+ * by SAMPLED_FAMILY_CONFIDENCE standard deviations, and only then is the
+ * pool narrowed to that family, in one pass.  A sample that reaches a
+ * quarter of the pool without such a lead (as when two families are close
+ * in size) gives way to the exact count, as do smaller pools.  The draws are
+ * seeded by the pool and guess, so a turn always gives the same answer.  Once
+ * the turn's deadline has passed the sample stops growing and its leader is
+ * taken as it stands, and the exact count is cut short by the deadline.
+ */
+unsigned int FindSampledWordFamily(char guessChar, WordBucket& wordBucket, vector<int>& possibleWords, PartitionScratch& partitionScratch) {
+    const unsigned int* letterMaskColumn = GetLetterMaskColumn(wordBucket, guessChar);
+    size_t poolSize = possibleWords.size();
+    double deadline = partitionScratch.turnDeadline;
+    if (poolSize < SAMPLED_FAMILY_MIN_POOL || letterMaskColumn == NULL) {
+        return FindLargestWordFamilyByDeadline(guessChar, wordBucket, possibleWords, partitionScratch, deadline);
+    }
+    size_t largestSample = poolSize / 4;
+    ReservePartitionScratch(partitionScratch, largestSample);
+    FamilyTable& familyTable = partitionScratch.familyTable;
+    InitializeFamilyTable(familyTable, largestSample, partitionScratch.arena);
+    unsigned int randomSeed = (unsigned int)poolSize * 31 + (unsigned int)possibleWords[0] + guessChar;
+    size_t sampleSize = 0;
+    for (size_t targetSize = SAMPLED_FAMILY_FIRST_SAMPLE; targetSize <= largestSample; targetSize *= 2) {
+        for (; sampleSize < targetSize; sampleSize++) {
+            AddToFamilyTable(familyTable, letterMaskColumn[possibleWords[rand_r(&randomSeed) % poolSize]], 1);
+        }
+        unsigned int leaderKey = EMPTY_FAMILY_KEY;
+        int leaderCount = 0, runnerUpCount = 0;
+        for (size_t slot = 0; slot < familyTable.slotCount; slot++) {
+            int count = familyTable.counts[slot];
+            if (count > leaderCount) {
+                runnerUpCount = leaderCount;
+                leaderCount = count;
+                leaderKey = familyTable.keys[slot];
+            } else if (count > runnerUpCount) {
+                runnerUpCount = count;
+            }
+        }
+        if (leaderCount - runnerUpCount > SAMPLED_FAMILY_CONFIDENCE * sqrt((double)(leaderCount + runnerUpCount)) ||
+            (deadline > 0 && GetMicroseconds() > deadline)) {
+            NarrowToWordFamily(wordBucket, possibleWords, guessChar, leaderKey);
+            return leaderKey;
+        }
+    }
+    return FindLargestWordFamilyByDeadline(guessChar, wordBucket, possibleWords, partitionScratch, deadline);
+}
+
+/*
+ * ChooseSampledWordFamily
+ * The sampled strategy: the greedy strategy with FindSampledWordFamily in
+ * place of FindLargestWordFamily, trading an occasional smaller family on
+ * the largest pools for not counting every word in them.  The opening book
+ * still answers the first two guesses when there is one.  Pools kept as
+ * CandidateBits are split exactly, which already costs less than sampling.
+ */
+unsigned int ChooseSampledWordFamily(char guessChar, WordBucket& wordBucket, vector<int>& possibleWords, string& guessedWord, string& charactersGuessed, PartitionScratch& partitionScratch) {
+    const OpeningBookEntry* openingEntry = FindOpeningBookEntry(wordBucket, possibleWords.size(), guessedWord, charactersGuessed, guessChar);
+    if (openingEntry != NULL) {
+        unsigned int familyKey = charactersGuessed.empty() ? openingEntry->firstFamilyKey : openingEntry->secondFamilyKey;
+        NarrowToWordFamily(wordBucket, possibleWords, guessChar, familyKey);
+        return familyKey;
+    }
+    return FindSampledWordFamily(guessChar, wordBucket, possibleWords, partitionScratch);
+}
+
+/*
+ * GetCandidateSplitBytes
+ * Returns the scratch arena bytes FindLargestFamilyInBits needs for a pool
+ * in the word bucket: two slots of blockCount block indices and bits for each
+ * depth of the split.
+ */
+size_t GetCandidateSplitBytes(WordBucket& wordBucket) {
+    size_t slotEntries = 2 * (wordBucket.wordLength + 1) * (size_t)wordBucket.blockCount;
+    return slotEntries * (sizeof(int) + sizeof(uint64_t)) + 2 * SCRATCH_ALIGNMENT;
+}
+
+/*
+ * SplitCandidateBits
+ * Splits the node of a candidate split in slot nodeSlot, the nodeWords words
+ * (in nodeBlocks nonzero blocks) whose family key agrees with familyKey at
+ * the positions before depth, into the words with and without the guess char
+ * at position depth, and goes on down both halves.  A node that has been
+ * split at every position is a family, and is kept if it is larger than the
+ * largest so far (or as large with a key IsFamilyKeyBefore it, as in
+ * FindLargestFamilyInTable).  Only the blocks of the node are visited, so the
+ * splits get cheaper as the pool shrinks, and a node of one word takes its
+ * family key straight from the letter mask index.
+ */
+POPCOUNT_CLONES
+void SplitCandidateBits(CandidateSplit& split, int depth, size_t nodeSlot, int nodeBlocks, int nodeWords, unsigned int familyKey) {
+    if (nodeWords < split.largestFamilySize) return;
+    WordBucket& wordBucket = *split.wordBucket;
+    size_t blockCount = wordBucket.blockCount;
+    const int* nodeIndices = split.blockIndices + nodeSlot * blockCount;
+    const uint64_t* nodeBits = split.blockBits + nodeSlot * blockCount;
+    if (nodeWords == 1) {
+        /* A single word's family is just its key in the letter mask index */
+        int wordIndex = nodeIndices[0] * 64 + __builtin_ctzll(nodeBits[0]);
+        familyKey = GetLetterMaskColumn(wordBucket, split.guessChar)[wordIndex];
+        depth = wordBucket.wordLength;
+    }
+    if (depth == wordBucket.wordLength) {
+        if (nodeWords > split.largestFamilySize || IsFamilyKeyBefore(familyKey, split.largestFamilyKey)) {
+            split.largestFamilyKey = familyKey;
+            split.largestFamilySize = nodeWords;
+        }
+        return;
+    }
+    
+    const uint64_t* positionRow = GetLetterBitRow(wordBucket, split.guessChar, depth);
+    size_t withSlot = 2 * (depth + 1);
+    size_t withoutSlot = withSlot + 1;
+    int* withIndices = split.blockIndices + withSlot * blockCount;
+    uint64_t* withBits = split.blockBits + withSlot * blockCount;
+    int* withoutIndices = split.blockIndices + withoutSlot * blockCount;
+    uint64_t* withoutBits = split.blockBits + withoutSlot * blockCount;
+    int withBlocks = 0, withoutBlocks = 0, withWords = 0;
+    for (int i = 0; i < nodeBlocks; i++) {
+        int block = nodeIndices[i];
+        uint64_t bits = nodeBits[i] & positionRow[block];
+        uint64_t otherBits = nodeBits[i] & ~positionRow[block];
+        withIndices[withBlocks] = block;
+        withBits[withBlocks] = bits;
+        withBlocks += bits != 0;
+        withoutIndices[withoutBlocks] = block;
+        withoutBits[withoutBlocks] = otherBits;
+        withoutBlocks += otherBits != 0;
+        withWords += __builtin_popcountll(bits);
+    }
+    int withoutWords = nodeWords - withWords;
+    
+    /* The larger half first, so that more of the smaller branches are dropped */
+    if (withWords >= withoutWords) {
+        if (withWords > 0) SplitCandidateBits(split, depth + 1, withSlot, withBlocks, withWords, familyKey | 1u << depth);
+        if (withoutWords > 0) SplitCandidateBits(split, depth + 1, withoutSlot, withoutBlocks, withoutWords, familyKey);
+    } else {
+        SplitCandidateBits(split, depth + 1, withoutSlot, withoutBlocks, withoutWords, familyKey);
+        if (withWords > 0) SplitCandidateBits(split, depth + 1, withSlot, withBlocks, withWords, familyKey | 1u << depth);
+    }
+}
+
+/*
+ * NarrowCandidateBits
+ * Takes in a word bucket and a candidate pool by reference and narrows the
+ * pool to the family of the guess char with the family key: an AND of each
+ * block with the letter's row for every position in the key and an ANDNOT
+ * with the row for every other position (or just an ANDNOT with its
+ * anywhere row for the family without it).  The pool's block range is
+ * narrowed to the blocks left nonzero.
+ */
+POPCOUNT_CLONES
+void NarrowCandidateBits(WordBucket& wordBucket, CandidateBits& candidateBits, char guessChar, unsigned int familyKey) {
+    if (guessChar < 'a' || guessChar > 'z') return;
+    size_t blockCount = wordBucket.blockCount;
+    const uint64_t* letterRows = GetLetterBitRow(wordBucket, guessChar, 0);
+    const uint64_t* anywhereRow = GetLetterBitRow(wordBucket, guessChar, wordBucket.wordLength);
+    int wordCount = 0, firstBlock = candidateBits.endBlock, endBlock = 0;
+    for (int i = candidateBits.firstBlock; i < candidateBits.endBlock; i++) {
+        uint64_t bits = candidateBits.blocks[i];
+        if (bits == 0) continue;
+        if (familyKey == 0) {
+            bits &= ~anywhereRow[i];
+        } else {
+            for (int j = 0; j < wordBucket.wordLength && bits != 0; j++) {
+                uint64_t positionBits = letterRows[j * blockCount + i];
+                bits &= (familyKey >> j & 1) ? positionBits : ~positionBits;
+            }
+        }
+        candidateBits.blocks[i] = bits;
+        if (bits != 0) {
+            firstBlock = min(firstBlock, i);
+            endBlock = i + 1;
+        }
+        wordCount += __builtin_popcountll(bits);
+    }
+    candidateBits.firstBlock = min(firstBlock, endBlock);
+    candidateBits.endBlock = endBlock;
+    candidateBits.wordCount = wordCount;
+}
+
+/*
+ * FindLargestFamilyInBits
+ * The bitset counterpart of FindLargestWordFamily, with the same result.
+ * The words without the guess char are one family, counted with an ANDNOT
+ * and a popcount, and the rest are split by SplitCandidateBits to size the
+ * others, so that no word is visited.  The pool is then narrowed to the
+ * largest family and its family key returned.
+ */
+POPCOUNT_CLONES
+unsigned int FindLargestFamilyInBits(char guessChar, WordBucket& wordBucket, CandidateBits& candidateBits, PartitionScratch& partitionScratch) {
+    if (guessChar < 'a' || guessChar > 'z') return 0;
+    ScratchArena& scratchArena = partitionScratch.arena;
+    ResetScratchArena(scratchArena, GetCandidateSplitBytes(wordBucket));
+    size_t slotEntries = 2 * (wordBucket.wordLength + 1) * (size_t)wordBucket.blockCount;
+    CandidateSplit split;
+    split.wordBucket = &wordBucket;
+    split.guessChar = guessChar;
+    split.blockIndices = (int*)AllocateScratch(scratchArena, slotEntries * sizeof(int));
+    split.blockBits = (uint64_t*)AllocateScratch(scratchArena, slotEntries * sizeof(uint64_t));
+    
+    METRIC_TIMER(countStart);
+    const uint64_t* anywhereRow = GetLetterBitRow(wordBucket, guessChar, wordBucket.wordLength);
+    int presentBlocks = 0, presentWords = 0;
+    for (int i = candidateBits.firstBlock; i < candidateBits.endBlock; i++) {
+        uint64_t bits = candidateBits.blocks[i] & anywhereRow[i];
+        split.blockIndices[presentBlocks] = i;
+        split.blockBits[presentBlocks] = bits;
+        presentBlocks += bits != 0;
+        presentWords += __builtin_popcountll(bits);
+    }
+    split.largestFamilyKey = presentWords < candidateBits.wordCount ? 0 : EMPTY_FAMILY_KEY;
+    split.largestFamilySize = candidateBits.wordCount - presentWords;
+    if (presentWords > 0) SplitCandidateBits(split, 0, 0, presentBlocks, presentWords, 0);
+    METRIC_OBSERVE_TIME(METRIC_COUNT_LARGEST_FAMILY, countStart);
+    
+    NarrowCandidateBits(wordBucket, candidateBits, guessChar, split.largestFamilyKey);
+    return split.largestFamilyKey;
+}
+
+/*
+ * ChooseLargestFamilyInBits
+ * The greedy strategy on a pool kept as CandidateBits, with the same result
+ * as ChooseLargestWordFamily.
+ */
+unsigned int ChooseLargestFamilyInBits(char guessChar, WordBucket& wordBucket, CandidateBits& candidateBits, string& guessedWord, string& charactersGuessed, PartitionScratch& partitionScratch) {
+    const OpeningBookEntry* openingEntry = FindOpeningBookEntry(wordBucket, candidateBits.wordCount, guessedWord, charactersGuessed, guessChar);
+    if (openingEntry != NULL) {
+        unsigned int familyKey = charactersGuessed.empty() ? openingEntry->firstFamilyKey : openingEntry->secondFamilyKey;
+        NarrowCandidateBits(wordBucket, candidateBits, guessChar, familyKey);
+        return familyKey;
+    }
+    return FindLargestFamilyInBits(guessChar, wordBucket, candidateBits, partitionScratch);
+}
+
+/*
+ * ChooseCandidateFamily
+ * Plays the family strategy on a pool kept as CandidateBits, directly when
+ * the strategy has a bitset version and otherwise on the pool listed out into
+ * the partition scratch.  Interactive turns have no deadline.
+ */
+unsigned int ChooseCandidateFamily(char guessChar, WordBucket& wordBucket, CandidateBits& candidateBits, string& guessedWord, string& charactersGuessed, PartitionScratch& partitionScratch) {
+    partitionScratch.turnDeadline = 0;
+    if (familyStrategy.chooseFamilyInBits != NULL) {
+        return familyStrategy.chooseFamilyInBits(guessChar, wordBucket, candidateBits, guessedWord, charactersGuessed, partitionScratch);
+    }
+    vector<int>& possibleWords = partitionScratch.candidateWords;
+    ListCandidateBits(candidateBits, possibleWords);
+    unsigned int familyKey = familyStrategy.chooseFamily(guessChar, wordBucket, possibleWords, guessedWord, charactersGuessed, partitionScratch);
+    SetCandidateBits(wordBucket, possibleWords, candidateBits);
+    return familyKey;
+}
+
+/*
+ * GetLetterBit, GetGuessedLetters
+ * A letter's bit in a set of letters, and the set of letters in a string of
+ * guessed characters.
+ */
+unsigned int GetLetterBit(char letter) {
+    return 1u << (letter - 'a');
+}
+
+unsigned int GetGuessedLetters(string& charactersGuessed) {
+    unsigned int guessedLetters = 0;
+    for (size_t i = 0; i < charactersGuessed.size(); i++) {
+        if (charactersGuessed[i] >= 'a' && charactersGuessed[i] <= 'z') guessedLetters |= GetLetterBit(charactersGuessed[i]);
+    }
+    return guessedLetters;
+}
+
+/*
+ * SetPatternLetter
+ * Writes letter into the positions of a revealed pattern named by a family
+ * key.  Writing '_' takes the letter back out.
+ */
+void SetPatternLetter(string& pattern, unsigned int familyKey, char letter) {
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (familyKey & (1u << i)) pattern[i] = letter;
+    }
+}
+
+/*
+ * IsLookaheadFamilyBefore
+ * Orders families largest first and breaks ties by IsFamilyKeyBefore, the
+ * order the greedy strategy prefers them in.
+ */
+bool IsLookaheadFamilyBefore(const LookaheadFamily& family, const LookaheadFamily& otherFamily) {
+    if (family.size != otherFamily.size) return family.size > otherFamily.size;
+    return IsFamilyKeyBefore(family.familyKey, otherFamily.familyKey);
+}
+
+/*
+ * SplitLookaheadPool
+ * Takes in the word bucket, wordCount word indices, a letter and a level by
+ * reference, and lists the families the letter splits the words into in the
+ * level, largest first.  With groupWords the level's words are filled as
+ * well; without it only the family sizes are counted.
+ */
+void SplitLookaheadPool(WordBucket& wordBucket, const int* words, size_t wordCount, char letter, bool groupWords, LookaheadLevel& level) {
+    const unsigned int* letterMaskColumn = GetLetterMaskColumn(wordBucket, letter);
+    FamilyTable& familyTable = level.familyTable;
+    ResetScratchArena(level.arena, GetFamilyTableSlots(wordCount) * (sizeof(unsigned int) + sizeof(int)) + 2 * SCRATCH_ALIGNMENT);
+    InitializeFamilyTable(familyTable, wordCount, level.arena);
+    for (size_t i = 0; i < wordCount; i++) {
+        AddToFamilyTable(familyTable, letterMaskColumn[words[i]], 1);
+    }
+    level.families.clear();
+    for (size_t slot = 0; slot < familyTable.slotCount; slot++) {
+        if (familyTable.counts[slot] == 0) continue;
+        LookaheadFamily family = {familyTable.keys[slot], 0, (size_t)familyTable.counts[slot]};
+        level.families.push_back(family);
+    }
+    sort(level.families.begin(), level.families.end(), IsLookaheadFamilyBefore);
+    if (!groupWords) return;
+    
+    /* Turn each family's count into the position of its next word */
+    size_t begin = 0;
+    for (size_t i = 0; i < level.families.size(); i++) {
+        level.families[i].begin = begin;
+        familyTable.counts[FindFamilySlot(familyTable, level.families[i].familyKey)] = (int)begin;
+        begin += level.families[i].size;
+    }
+    if (level.words.size() < wordCount) level.words.resize(wordCount);
+    for (size_t i = 0; i < wordCount; i++) {
+        level.words[familyTable.counts[FindFamilySlot(familyTable, letterMaskColumn[words[i]])]++] = words[i];
+    }
+}
+
+/*
+ * GetLookaheadPoolValue
+ * Estimates the misses still to come from a pool of wordCount words left
+ * when the search stops looking ahead as LOOKAHEAD_POOL_WEIGHT per halving
+ * of the pool, since a guess rarely does better than halve it.  Without this
+ * the search would trade a large pool for a miss now and lose the game
+ * later.  A single word is worth nothing, since the player can finish it
+ * without missing.
+ */
+double GetLookaheadPoolValue(size_t wordCount) {
+    return LOOKAHEAD_POOL_WEIGHT * log((double)wordCount) / log(2.0);
+}
+
+/*
+ * SearchLookaheadState
+ * Minimax with alpha-beta pruning over the game from a state the lookahead
+ * search reached: the wordCount words at words, the worker's pattern and
+ * guessedLetters.  Returns the misses the adversary can force in the player's
+ * next depth guesses plus the value of the pool left at the end, when the
+ * player picks each letter to keep that as low as possible and the adversary
+ * answers with the family that makes it as high as possible.  Letters that
+ * do not split the pool are skipped, since they tell the player nothing.  A
+ * result at or below alpha or at or above beta is only a bound.  States are
+ * memoized for the turn, and a state searched at a shallower depth has its
+ * best reply tried first.  Letters are otherwise tried in order of English
+ * frequency, which usually finds a good reply early and prunes the rest.
+ */
+double SearchLookaheadState(LookaheadWorker& worker, const int* words, size_t wordCount, unsigned int guessedLetters, int depth, double alpha, double beta) {
+    LookaheadSearch& search = *worker.search;
+    if (wordCount <= 1) return 0;
+    if (depth == 0) {
+        search.horizonReached = true;
+        return GetLookaheadPoolValue(wordCount);
+    }
+    if (search.aborted || GetMicroseconds() > search.deadline) {
+        search.aborted = true;
+        return 0;
+    }
+    worker.nodes++;
+    
+    string memoKey = worker.pattern;
+    memoKey.append((const char*)&guessedLetters, sizeof(guessedLetters));
+    char shallowBestLetter = 0;
+    map<string, LookaheadMemoEntry>::iterator memoEntry = worker.memo.find(memoKey);
+    if (memoEntry != worker.memo.end()) {
+        LookaheadMemoEntry& entry = memoEntry->second;
+        if (entry.depth == depth && (entry.bound == LOOKAHEAD_EXACT ||
+                                     (entry.bound == LOOKAHEAD_LOWER_BOUND && entry.value >= beta) ||
+                                     (entry.bound == LOOKAHEAD_UPPER_BOUND && entry.value <= alpha))) {
+            return entry.value;
+        }
+        shallowBestLetter = entry.bestLetter;
+    }
+    
+    LookaheadLevel& level = worker.levels[depth];
+    double bestValue = HUGE_VAL;
+    char bestLetter = 0;
+    for (int order = -1; order < (int)LETTER_FREQUENCY_ORDER.size() && bestValue > alpha && !search.aborted; order++) {
+        char letter = order < 0 ? shallowBestLetter : LETTER_FREQUENCY_ORDER[order];
+        if (letter == 0 || (order >= 0 && letter == shallowBestLetter) || (guessedLetters & GetLetterBit(letter))) continue;
+        SplitLookaheadPool(*search.wordBucket, words, wordCount, letter, depth > 1, level);
+        if (level.families.size() < 2) continue;
+        
+        /* The adversary's answer, given up once it is worse for the player than a letter already tried */
+        double cutoff = min(beta, bestValue);
+        double letterValue = -HUGE_VAL;
+        for (size_t i = 0; i < level.families.size() && letterValue < cutoff; i++) {
+            LookaheadFamily& family = level.families[i];
+            double miss = family.familyKey == 0 ? 1 : 0;
+            const int* familyWords = depth > 1 ? &level.words[family.begin] : NULL;
+            SetPatternLetter(worker.pattern, family.familyKey, letter);
+            double familyValue = miss + SearchLookaheadState(worker, familyWords, family.size, guessedLetters | GetLetterBit(letter),
+                                                             depth - 1, max(alpha, letterValue) - miss, cutoff - miss);
+            SetPatternLetter(worker.pattern, family.familyKey, '_');
+            letterValue = max(letterValue, familyValue);
+        }
+        if (letterValue < bestValue) {
+            bestValue = letterValue;
+            bestLetter = letter;
+        }
+    }
+    if (search.aborted) return 0;
+    if (bestLetter == 0) bestValue = 0;
+    
+    LookaheadMemoEntry entry;
+    entry.depth = depth;
+    entry.value = bestValue;
+    entry.bound = bestValue <= alpha ? LOOKAHEAD_UPPER_BOUND : bestValue >= beta ? LOOKAHEAD_LOWER_BOUND : LOOKAHEAD_EXACT;
+    entry.bestLetter = bestLetter;
+    worker.memo[memoKey] = entry;
+    return bestValue;
+}
+
+/*
+ * LookaheadWorkerMain
+ * The body of each lookahead search thread.  Claims root families until
+ * there are none left and stores each one's value: the miss it costs the
+ * player, if any, plus the search of the state it leads to.  Root families
+ * are searched with an open window, so their values are exact.
+ */
+void* LookaheadWorkerMain(void* workerPointer) {
+    LookaheadWorker& worker = *(LookaheadWorker*)workerPointer;
+    LookaheadSearch& search = *worker.search;
+    vector<LookaheadFamily>& families = search.rootLevel.families;
+    while (!search.aborted) {
+        int familyIndex = __sync_fetch_and_add(&search.nextFamily, 1);
+        if (familyIndex >= (int)families.size()) break;
+        LookaheadFamily& family = families[familyIndex];
+        worker.pattern = search.rootPattern;
+        SetPatternLetter(worker.pattern, family.familyKey, search.guessChar);
+        search.familyValues[familyIndex] = (family.familyKey == 0 ? 1 : 0) +
+            SearchLookaheadState(worker, &search.rootLevel.words[family.begin], family.size, search.rootGuessedLetters,
+                                 search.depth, -HUGE_VAL, HUGE_VAL);
+    }
+    return NULL;
+}
+
+/*
+ * RunLookaheadWorkers
+ * Runs the first workerCount lookahead workers, the first on the calling
+ * thread and the rest on threads of their own, and waits for all of them.
+ */
+void RunLookaheadWorkers(PartitionScratch& partitionScratch, int workerCount) {
+    vector<LookaheadWorker>& workers = partitionScratch.lookaheadWorkers;
+    vector<pthread_t>& threads = partitionScratch.threads;
+    threads.resize(workerCount);
+    for (int i = 1; i < workerCount; i++) {
+        pthread_create(&threads[i], NULL, LookaheadWorkerMain, &workers[i]);
+    }
+    LookaheadWorkerMain(&workers[0]);
+    for (int i = 1; i < workerCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/*
+ * FindBestLookaheadFamily
+ * Returns the index of the root family with the highest value.  Families
+ * are listed largest first, so ties go the way the greedy strategy would.
+ */
+size_t FindBestLookaheadFamily(LookaheadSearch& lookaheadSearch) {
+    size_t bestFamily = 0;
+    for (size_t i = 1; i < lookaheadSearch.familyValues.size(); i++) {
+        if (lookaheadSearch.familyValues[i] > lookaheadSearch.familyValues[bestFamily]) bestFamily = i;
+    }
+    return bestFamily;
+}
+
+/*
+ * ChooseLookaheadWordFamily
+ * The lookahead strategy.  Instead of the largest family it picks the one
+ * that lets the adversary force the most misses over the player's next
+ * lookaheadDepth guesses (see SearchLookaheadState), which makes for longer
+ * games.  The search deepens one guess at a time and keeps the choice of the
+ * deepest depth finished within lookaheadBudget microseconds (or by the
+ * turn's deadline if that comes first), or stops early once no state is
+ * left unsolved.  Depth 0, the value of each family's miss
+ * and pool alone, always finishes.  Large pools are searched on up to
+ * partitionThreadCount threads, one root family at a time.  Unlike the
+ * greedy strategy the search allocates, for its memo and levels.
+ */
+unsigned int ChooseLookaheadWordFamily(char guessChar, WordBucket& wordBucket, vector<int>& possibleWords, string& guessedWord, string& charactersGuessed, PartitionScratch& partitionScratch) {
+    if (possibleWords.empty() || GetLetterMaskColumn(wordBucket, guessChar) == NULL) {
+        return FindLargestWordFamily(guessChar, wordBucket, possibleWords, partitionScratch);
+    }
+    LookaheadSearch& search = partitionScratch.lookaheadSearch;
+    vector<LookaheadFamily>& families = search.rootLevel.families;
+    search.wordBucket = &wordBucket;
+    search.guessChar = guessChar;
+    SplitLookaheadPool(wordBucket, &possibleWords[0], possibleWords.size(), guessChar, true, search.rootLevel);
+    search.familyValues.resize(families.size());
+    for (size_t i = 0; i < families.size(); i++) {
+        search.familyValues[i] = (families[i].familyKey == 0 ? 1 : 0) + GetLookaheadPoolValue(families[i].size);
+    }
+    size_t bestFamily = FindBestLookaheadFamily(search);
+    search.completedDepth = families.size() > 1 ? 0 : lookaheadDepth;
+    
+    if (families.size() > 1 && lookaheadDepth > 0) {
+        search.rootPattern = guessedWord;
+        search.rootGuessedLetters = GetGuessedLetters(charactersGuessed) | GetLetterBit(guessChar);
+        search.deadline = GetMicroseconds() + lookaheadBudget;
+        if (partitionScratch.turnDeadline > 0) search.deadline = min(search.deadline, partitionScratch.turnDeadline);
+        int workerCount = 1;
+        if (partitionThreadCount > 1 && possibleWords.size() >= LOOKAHEAD_PARALLEL_POOL) {
+            workerCount = min(partitionThreadCount, (int)families.size());
+        }
+        vector<LookaheadWorker>& workers = partitionScratch.lookaheadWorkers;
+        if (workers.size() < (size_t)workerCount) workers.resize(workerCount);
+        for (int i = 0; i < workerCount; i++) {
+            workers[i].search = &search;
+            workers[i].levels.resize(lookaheadDepth + 1);
+            workers[i].memo.clear();
+            workers[i].nodes = 0;
+        }
+        for (int depth = 1; depth <= lookaheadDepth; depth++) {
+            search.depth = depth;
+            search.aborted = false;
+            search.horizonReached = false;
+            search.nextFamily = 0;
+            RunLookaheadWorkers(partitionScratch, workerCount);
+            if (search.aborted) break;
+            bestFamily = FindBestLookaheadFamily(search);
+            search.completedDepth = search.horizonReached ? depth : lookaheadDepth;
+            if (!search.horizonReached) break;
+        }
+    }
+    
+    LookaheadFamily& family = families[bestFamily];
+    copy(search.rootLevel.words.begin() + family.begin, search.rootLevel.words.begin() + family.begin + family.size, possibleWords.begin());
+    possibleWords.resize(family.size);
+    return family.familyKey;
+}
+
+/*
+ * FindFamilyStrategy
+ * Takes in a strategy name and a strategy by reference and sets the strategy
+ * to the one of that name in FAMILY_STRATEGIES, returning false if there is
+ * none.
+ */
+bool FindFamilyStrategy(string strategyName, FamilyStrategy& strategy) {
+    for (size_t i = 0; i < sizeof(FAMILY_STRATEGIES) / sizeof(FAMILY_STRATEGIES[0]); i++) {
+        if (strategyName == FAMILY_STRATEGIES[i].name) {
+            strategy = FAMILY_STRATEGIES[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * UpdateGuessedWordAndCharactersGuessed
+ * Updates the guessedWord and charactersGuessed strings according to the family key
+ * of the new possible words.  The strings to be updated are taken in by reference
+ * and the family key and characterGuessed by value.
+ */
+void UpdateGuessedWordAndCharactersGuessed(unsigned int familyKey, string& guessedWord, string& charactersGuessed, char guessChar) {
+    if (!guessedWord.empty() && guessedWord.size() <= MAX_WORD_LENGTH) {
+        WORD_LENGTH_KERNELS[guessedWord.size()].revealFamily(familyKey, &guessedWord[0], guessChar);
+    } else if (!guessedWord.empty()) {
+        RevealFamilyGeneric(familyKey, &guessedWord[0], (int)guessedWord.size(), guessChar);
+    }
+    charactersGuessed += guessChar;
+}
+
+/*
+ * RevealFamilyGeneric
+ * Writes the guess char into the pattern at the positions of the family
+ * key, for any word length.
+ */
+void RevealFamilyGeneric(unsigned int familyKey, char* pattern, int wordLength, char guessChar) {
+    for(int i = 0; i < wordLength; i++) {
+        if(familyKey & (1u << i)) {
+            pattern[i] = guessChar;
+        }
+    }
+}
+
+/*
+ * IsWordGuessed
+ * Takes in a string word and returns false
+ * if it contains blank "_" [underscore] characters
+ * and returns true if it is a complete word.
+ */
+bool IsWordGuessed(string& guessedWord) {
+    if (guessedWord.empty()) return true;
+    if (guessedWord.size() > MAX_WORD_LENGTH) return !HasBlankGeneric(guessedWord.data(), (int)guessedWord.size());
+    return !WORD_LENGTH_KERNELS[guessedWord.size()].hasBlank(guessedWord.data());
+}
+
+/*
+ * HasBlankGeneric
+ * Returns whether a pattern of any word length has a blank left.
+ */
+bool HasBlankGeneric(const char* pattern, int wordLength) {
+    char blank = '_';
+    for(int i = 0; i < wordLength; i++) {
+        if (pattern[i] == blank) return true;
+    }
+    return false;
+}
+
+/*
+ * LoadWordBuckets
+ * Takes in a compiled dictionary and a vector of word buckets by reference and
+ * fills wordBuckets[length] for every length up to MAX_WORD_LENGTH, so that a
+ * server can start games of any length from one shared, read-only copy of the
+ * dictionary, loaded by LoadDictionary.
+ */
+void LoadWordBuckets(CompiledDictionary& compiledDictionary, vector<WordBucket>& wordBuckets) {
+    wordBuckets.resize(MAX_WORD_LENGTH + 1);
+    LoadDictionary(compiledDictionary);
+    for (int wordLength = 0; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        FindCompiledWordBucket(compiledDictionary, wordLength, wordBuckets[wordLength]);
+    }
+}
+
+/*
+ * StartHangmanGame
+ * Takes in the shared word buckets, a word length, a number of guesses and a
+ * game by reference.  Sets the game up to guess a word of that length and
+ * returns false if there are no such words or the number of guesses is not
+ * positive.
+ */
+bool StartHangmanGame(vector<WordBucket>& wordBuckets, int wordLength, int guesses, HangmanGame& game) {
+    if (wordLength <= 0 || wordLength > MAX_WORD_LENGTH || wordBuckets[wordLength].wordCount == 0 || guesses <= 0) {
+        return false;
+    }
+    game.wordLength = wordLength;
+    game.guessesRemaining = guesses;
+    InitializeGuessedWord(wordLength, game.guessedWord);
+    game.charactersGuessed = "";
+    game.charactersGuessed.reserve(ALPHABET.size());
+    InitializePossibleWordIndices(wordBuckets[wordLength], game.possibleWords);
+    return true;
+}
+
+/*
+ * GetLargestWordBucketSize
+ * Returns the number of words in the largest word bucket, the largest pool a
+ * turn can be played on, for sizing partition scratch space.
+ */
+size_t GetLargestWordBucketSize(vector<WordBucket>& wordBuckets) {
+    size_t largestBucketSize = 0;
+    for (size_t wordLength = 0; wordLength < wordBuckets.size(); wordLength++) {
+        largestBucketSize = max(largestBucketSize, (size_t)wordBuckets[wordLength].wordCount);
+    }
+    return largestBucketSize;
+}
+
+/*
+ * PlayHangmanGuess
+ * The non-interactive counterpart of PlayTurn.  Takes in the shared word
+ * buckets, a game by reference, a guess character that has not been guessed
+ * yet, the calling thread's partition scratch space, the shared partition
+ * cache (or NULL) and the time the turn must be answered by (or 0), and
+ * narrows the game to the family familyStrategy picks for the guess.  Large
+ * pools are looked up in the cache first and partitioned results are added
+ * to it.  A turn that reaches the strategy after its deadline, having waited
+ * too long for a worker, gets the sampled strategy's family instead, which
+ * is far cheaper than a lookahead search or an exact count of a large pool.
+ * A turn that runs into the deadline is cut short: a family count settles on
+ * the largest family of the words it has counted and a search keeps the
+ * deepest depth it finished.  Turns answered after their deadline are kept
+ * out of the cache, since they may not be the strategy's choice.  Returns
+ * the key of the family the game was narrowed to.  Only uncached greedy
+ * turns are free of allocation.
+ */
+unsigned int PlayHangmanGuess(vector<WordBucket>& wordBuckets, HangmanGame& game, char guessChar, PartitionScratch& partitionScratch, PartitionCache* partitionCache, double deadline) {
+    METRIC_TIMER(turnStart);
+    METRIC_OBSERVE(METRIC_POOL_BEFORE_GUESS, game.possibleWords.size());
+    METRIC_ALLOCATION_MARK(turnBytes);
+    partitionScratch.turnDeadline = deadline;
+    ChooseFamilyFunction chooseFamily = familyStrategy.chooseFamily;
+    if (deadline > 0 && GetMicroseconds() > deadline) chooseFamily = ChooseSampledWordFamily;
+    unsigned int familyKey;
+    if (partitionCache != NULL && game.possibleWords.size() >= PARTITION_CACHE_MIN_POOL) {
+        string cacheKey = MakePartitionCacheKey(game, guessChar);
+        if (!FindCachedFamily(*partitionCache, cacheKey, game.possibleWords, familyKey)) {
+            familyKey = chooseFamily(guessChar, wordBuckets[game.wordLength], game.possibleWords, game.guessedWord, game.charactersGuessed, partitionScratch);
+            if (deadline == 0 || GetMicroseconds() <= deadline) AddCachedFamily(*partitionCache, cacheKey, familyKey, game.possibleWords);
+        }
+    } else {
+        familyKey = chooseFamily(guessChar, wordBuckets[game.wordLength], game.possibleWords, game.guessedWord, game.charactersGuessed, partitionScratch);
+    }
+    if (familyKey == 0) game.guessesRemaining--;
+    UpdateGuessedWordAndCharactersGuessed(familyKey, game.guessedWord, game.charactersGuessed, guessChar);
+    METRIC_OBSERVE(METRIC_POOL_AFTER_GUESS, game.possibleWords.size());
+    METRIC_OBSERVE_ALLOCATION(METRIC_TURN_BYTES_ALLOCATED, turnBytes);
+    METRIC_OBSERVE_TIME(METRIC_TURN, turnStart);
+    return familyKey;
+}
+
+/*
+ * InitializePartitionCache
+ * Sets up an empty partition cache holding at most wordCapacity word indices.
+ */
+void InitializePartitionCache(PartitionCache& partitionCache, size_t wordCapacity) {
+    pthread_mutex_init(&partitionCache.lock, NULL);
+    partitionCache.entries.clear();
+    partitionCache.entryIndex.clear();
+    partitionCache.wordCapacity = wordCapacity;
+    partitionCache.wordCount = 0;
+    partitionCache.hits = 0;
+    partitionCache.misses = 0;
+}
+
+/*
+ * MakePartitionCacheKey
+ * Returns the cache key for playing guessChar in a game: the word length,
+ * the revealed pattern, the guessed letters as a 26 bit set (so the order
+ * they were guessed in does not matter) and the guess char.
+ */
+string MakePartitionCacheKey(HangmanGame& game, char guessChar) {
+    uint32_t guessedLetters = 0;
+    for (size_t i = 0; i < game.charactersGuessed.size(); i++) {
+        guessedLetters |= 1u << (game.charactersGuessed[i] - 'a');
+    }
+    string cacheKey;
+    cacheKey.reserve(game.guessedWord.size() + 6);
+    cacheKey += (char)game.wordLength;
+    cacheKey += game.guessedWord;
+    cacheKey.append((const char*)&guessedLetters, sizeof(guessedLetters));
+    cacheKey += guessChar;
+    return cacheKey;
+}
+
+/*
+ * FindCachedFamily
+ * Looks the key up in the partition cache.  On a hit, copies the cached pool
+ * into possibleWords (which only ever shrinks, so this does not allocate),
+ * sets familyKey, marks the entry most recently used and returns true.
+ */
+bool FindCachedFamily(PartitionCache& partitionCache, string& cacheKey, vector<int>& possibleWords, unsigned int& familyKey) {
+    pthread_mutex_lock(&partitionCache.lock);
+    map<string, list<CachedFamily>::iterator>::iterator entryItr = partitionCache.entryIndex.find(cacheKey);
+    bool found = entryItr != partitionCache.entryIndex.end();
+    if (found) {
+        list<CachedFamily>::iterator entry = entryItr->second;
+        partitionCache.entries.splice(partitionCache.entries.begin(), partitionCache.entries, entry);
+        familyKey = entry->familyKey;
+        possibleWords.assign(entry->familyWords.begin(), entry->familyWords.end());
+        partitionCache.hits++;
+    } else {
+        partitionCache.misses++;
+    }
+    pthread_mutex_unlock(&partitionCache.lock);
+    return found;
+}
+
+/*
+ * AddCachedFamily
+ * Adds a partitioned turn to the cache, unless another game beat us to it,
+ * and drops least recently used entries until the cache fits its capacity.
+ * Pools larger than the whole capacity are not cached.
+ */
+void AddCachedFamily(PartitionCache& partitionCache, string& cacheKey, unsigned int familyKey, vector<int>& familyWords) {
+    if (familyWords.size() > partitionCache.wordCapacity) return;
+    CachedFamily cachedFamily;
+    cachedFamily.cacheKey = cacheKey;
+    cachedFamily.familyKey = familyKey;
+    cachedFamily.familyWords = familyWords;
+    
+    pthread_mutex_lock(&partitionCache.lock);
+    if (partitionCache.entryIndex.find(cacheKey) == partitionCache.entryIndex.end()) {
+        partitionCache.entries.push_front(cachedFamily);
+        partitionCache.entryIndex[cacheKey] = partitionCache.entries.begin();
+        partitionCache.wordCount += familyWords.size();
+        while (partitionCache.wordCount > partitionCache.wordCapacity) {
+            CachedFamily& leastRecent = partitionCache.entries.back();
+            partitionCache.wordCount -= leastRecent.familyWords.size();
+            partitionCache.entryIndex.erase(leastRecent.cacheKey);
+            partitionCache.entries.pop_back();
+        }
+    }
+    pthread_mutex_unlock(&partitionCache.lock);
+}
+
+/*
+ * PrewarmPartitionCache
+ * Fills the cache with the most likely opening turns: for every word length,
+ * the first openingLetters letters by English frequency as a first guess,
+ * and each of them followed by each of the others.  Hit and miss counts are
+ * reset afterwards so they only describe real games.
+ */
+void PrewarmPartitionCache(vector<WordBucket>& wordBuckets, PartitionCache& partitionCache, int openingLetters) {
+    openingLetters = min(openingLetters, (int)LETTER_FREQUENCY_ORDER.size());
+    HangmanGame openingGame, secondGame;
+    PartitionScratch partitionScratch;
+    for (int wordLength = 1; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        for (int first = 0; first < openingLetters; first++) {
+            if (!StartHangmanGame(wordBuckets, wordLength, (int)ALPHABET.size(), openingGame)) break;
+            PlayHangmanGuess(wordBuckets, openingGame, LETTER_FREQUENCY_ORDER[first], partitionScratch, &partitionCache, 0);
+            for (int second = 0; second < openingLetters; second++) {
+                if (second == first) continue;
+                secondGame = openingGame;
+                PlayHangmanGuess(wordBuckets, secondGame, LETTER_FREQUENCY_ORDER[second], partitionScratch, &partitionCache, 0);
+            }
+        }
+    }
+    pthread_mutex_lock(&partitionCache.lock);
+    partitionCache.hits = 0;
+    partitionCache.misses = 0;
+    pthread_mutex_unlock(&partitionCache.lock);
+}
+
+/*
+ * DescribePartitionCache
+ * Returns the cache's counters as "<hits> <misses> <entries> <words>".
+ */
+string DescribePartitionCache(PartitionCache& partitionCache) {
+    stringstream description;
+    pthread_mutex_lock(&partitionCache.lock);
+    description << partitionCache.hits << " " << partitionCache.misses << " "
+                << partitionCache.entryIndex.size() << " " << partitionCache.wordCount;
+    pthread_mutex_unlock(&partitionCache.lock);
+    return description.str();
+}
+
+/*
+ * DescribeHangmanGame
+ * Returns a game's status line for the server protocol:
+ *   PLAY <guessedWord> <guessesRemaining> <wordsRemaining>
+ * with WIN in place of PLAY once the word is guessed, and LOSE followed by
+ * the word once the guesses have run out.
+ */
+string DescribeHangmanGame(vector<WordBucket>& wordBuckets, HangmanGame& game) {
+    stringstream description;
+    if (IsWordGuessed(game.guessedWord)) {
+        description << "WIN ";
+    } else if (game.guessesRemaining == 0) {
+        description << "LOSE ";
+    } else {
+        description << "PLAY ";
+    }
+    description << game.guessedWord << " " << game.guessesRemaining << " " << game.possibleWords.size();
+    if (game.guessesRemaining == 0 && !IsWordGuessed(game.guessedWord)) {
+        description << " " << string(GetBucketWord(wordBuckets[game.wordLength], game.possibleWords[0]), game.wordLength);
+    }
+    return description.str();
+}
+
+/*
+ * AppendSnapshotGap
+ * Appends a pool gap to a snapshot as a variable length integer.
+ */
+void AppendSnapshotGap(string& snapshot, uint32_t gap) {
+    while (gap >= 0x80) {
+        snapshot += (char)((gap & 0x7F) | 0x80);
+        gap >>= 7;
+    }
+    snapshot += (char)gap;
+}
+
+/*
+ * ReadSnapshotGap
+ * Reads a variable length integer from the snapshot bytes at position into
+ * gap and moves position past it.  Returns false if it runs past end.
+ */
+bool ReadSnapshotGap(const unsigned char*& position, const unsigned char* end, uint32_t& gap) {
+    gap = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        if (position == end) return false;
+        unsigned char byte = *position++;
+        gap |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+/*
+ * SaveHangmanGame
+ * Takes in a game's word bucket and the game by reference and writes the
+ * game's compact snapshot (see GameSnapshotHeader) into snapshot, replacing
+ * what was there, so that RestoreHangmanGame can carry on the game in
+ * another process.  The pool is in increasing order, as every turn keeps it.
+ */
+void SaveHangmanGame(WordBucket& wordBucket, HangmanGame& game, string& snapshot) {
+    vector<int>& possibleWords = game.possibleWords;
+    size_t bitBytes = (wordBucket.wordCount + 7) / 8;
+    size_t gapBytes = 0;
+    for (size_t i = 0; i < possibleWords.size() && gapBytes < bitBytes; i++) {
+        uint32_t gap = possibleWords[i] - (i > 0 ? possibleWords[i - 1] + 1 : 0);
+        gapBytes += gap < 1u << 7 ? 1 : gap < 1u << 14 ? 2 : gap < 1u << 21 ? 3 : gap < 1u << 28 ? 4 : 5;
+    }
+    
+    GameSnapshotHeader header;
+    memcpy(header.magic, GAME_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = GAME_SNAPSHOT_VERSION;
+    header.wordLength = (uint8_t)game.wordLength;
+    header.poolEncoding = gapBytes < bitBytes ? SNAPSHOT_POOL_GAPS : SNAPSHOT_POOL_BITS;
+    header.guessCount = (uint8_t)game.charactersGuessed.size();
+    header.guessesRemaining = game.guessesRemaining;
+    header.poolWordCount = (uint32_t)possibleWords.size();
+    header.wordsChecksum = wordBucket.wordsChecksum;
+    snapshot.assign((const char*)&header, sizeof(header));
+    snapshot += game.charactersGuessed;
+    if (header.poolEncoding == SNAPSHOT_POOL_GAPS) {
+        for (size_t i = 0; i < possibleWords.size(); i++) {
+            AppendSnapshotGap(snapshot, possibleWords[i] - (i > 0 ? possibleWords[i - 1] + 1 : 0));
+        }
+    } else {
+        size_t poolOffset = snapshot.size();
+        snapshot.append(bitBytes, '\0');
+        char* poolBits = &snapshot[poolOffset];
+        for (size_t i = 0; i < possibleWords.size(); i++) {
+            poolBits[possibleWords[i] / 8] |= 1 << (possibleWords[i] % 8);
+        }
+    }
+}
+
+/*
+ * RestoreHangmanGame
+ * Takes in the shared word buckets, a snapshot made by SaveHangmanGame and a
+ * game by reference and sets the game to the one in the snapshot.  Returns
+ * false, leaving the game in an unspecified state, if the snapshot is
+ * malformed, was not made with the loaded dictionary's words of its length
+ * or has no guesses remaining (or more than an int holds).  Since every turn
+ * keeps the whole family it picks, a real game's pool is exactly the
+ * bucket's words that agree with its pattern on every guessed letter, and a
+ * snapshot with any other pool is rejected too: its turns would otherwise be
+ * added to the shared partition cache under the pattern and be handed to
+ * other games.
+ */
+bool RestoreHangmanGame(vector<WordBucket>& wordBuckets, const string& snapshot, HangmanGame& game) {
+    GameSnapshotHeader header;
+    if (snapshot.size() < sizeof(header)) return false;
+    memcpy(&header, snapshot.data(), sizeof(header));
+    if (memcmp(header.magic, GAME_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != GAME_SNAPSHOT_VERSION ||
+        header.wordLength < 1 || header.wordLength > MAX_WORD_LENGTH || header.guessCount > ALPHABET.size()) {
+        return false;
+    }
+    WordBucket& wordBucket = wordBuckets[header.wordLength];
+    if (header.wordsChecksum != wordBucket.wordsChecksum || header.guessesRemaining < 1 || header.guessesRemaining > (uint32_t)INT_MAX ||
+        header.poolWordCount < 1 || header.poolWordCount > (uint32_t)wordBucket.wordCount || snapshot.size() < sizeof(header) + header.guessCount) {
+        return false;
+    }
+    game.wordLength = header.wordLength;
+    game.guessesRemaining = (int)header.guessesRemaining;
+    game.charactersGuessed.assign(snapshot, sizeof(header), header.guessCount);
+    unsigned int guessedLetters = 0;
+    for (size_t i = 0; i < game.charactersGuessed.size(); i++) {
+        char letter = game.charactersGuessed[i];
+        if (letter < 'a' || letter > 'z' || (guessedLetters & GetLetterBit(letter)) != 0) return false;
+        guessedLetters |= GetLetterBit(letter);
+    }
+    
+    /* The pool */
+    const unsigned char* position = (const unsigned char*)snapshot.data() + sizeof(header) + header.guessCount;
+    const unsigned char* end = (const unsigned char*)snapshot.data() + snapshot.size();
+    vector<int>& possibleWords = game.possibleWords;
+    possibleWords.clear();
+    if (header.poolEncoding == SNAPSHOT_POOL_GAPS) {
+        uint32_t wordIndex = 0;
+        for (uint32_t i = 0; i < header.poolWordCount; i++) {
+            uint32_t gap;
+            if (!ReadSnapshotGap(position, end, gap) || gap >= wordBucket.wordCount - wordIndex) return false;
+            wordIndex += gap;
+            possibleWords.push_back(wordIndex++);
+        }
+        if (position != end) return false;
+    } else if (header.poolEncoding == SNAPSHOT_POOL_BITS) {
+        if (end - position != (wordBucket.wordCount + 7) / 8) return false;
+        for (int i = 0; position + i < end; i++) {
+            for (unsigned int bits = position[i]; bits != 0; bits &= bits - 1) {
+                possibleWords.push_back(i * 8 + __builtin_ctz(bits));
+            }
+        }
+        if (possibleWords.size() != header.poolWordCount || possibleWords.back() >= wordBucket.wordCount) return false;
+    } else {
+        return false;
+    }
+    
+    /* The pattern revealed so far is any word of the pool's guessed letters */
+    const char* word = GetBucketWord(wordBucket, possibleWords[0]);
+    game.guessedWord.assign(game.wordLength, '_');
+    for (int i = 0; i < game.wordLength; i++) {
+        if (word[i] >= 'a' && word[i] <= 'z' && (guessedLetters & GetLetterBit(word[i])) != 0) {
+            game.guessedWord[i] = word[i];
+        }
+    }
+    
+    /* The pool must be every word with the first word's family for each guessed letter */
+    const unsigned int* letterMaskColumns[26];
+    unsigned int patternMasks[26];
+    for (size_t i = 0; i < game.charactersGuessed.size(); i++) {
+        letterMaskColumns[i] = GetLetterMaskColumn(wordBucket, game.charactersGuessed[i]);
+        patternMasks[i] = letterMaskColumns[i][possibleWords[0]];
+    }
+    size_t poolIndex = 0;
+    for (int wordIndex = 0; wordIndex < wordBucket.wordCount; wordIndex++) {
+        bool agrees = true;
+        for (size_t i = 0; i < game.charactersGuessed.size() && agrees; i++) {
+            agrees = letterMaskColumns[i][wordIndex] == patternMasks[i];
+        }
+        if (agrees != (poolIndex < possibleWords.size() && possibleWords[poolIndex] == wordIndex)) return false;
+        poolIndex += agrees;
+    }
+    return true;
+}
+
+/*
+ * EncodeHex, DecodeHex
+ * Convert bytes to lowercase hexadecimal text and back, for carrying game
+ * snapshots over the line protocol.  DecodeHex returns false if the text is
+ * not hexadecimal.
+ */
+string EncodeHex(const string& bytes) {
+    static const char digits[] = "0123456789abcdef";
+    string text(bytes.size() * 2, '0');
+    for (size_t i = 0; i < bytes.size(); i++) {
+        text[2 * i] = digits[(unsigned char)bytes[i] >> 4];
+        text[2 * i + 1] = digits[bytes[i] & 0xF];
+    }
+    return text;
+}
+
+bool DecodeHex(const string& text, string& bytes) {
+    if (text.size() % 2 != 0) return false;
+    bytes.resize(text.size() / 2);
+    for (size_t i = 0; i < text.size(); i++) {
+        char digit = tolower(text[i]);
+        int value;
+        if (digit >= '0' && digit <= '9') {
+            value = digit - '0';
+        } else if (digit >= 'a' && digit <= 'f') {
+            value = digit - 'a' + 10;
+        } else {
+            return false;
+        }
+        bytes[i / 2] = (char)(i % 2 == 0 ? value << 4 : bytes[i / 2] | value);
+    }
+    return true;
+}
+
+/*
+ * OpenReplayLog
+ * Opens the replay log games are recorded to, appending to it if it exists.
+ * Returns false if it cannot be opened.
+ */
+bool OpenReplayLog(string fileName) {
+    replayLog.file = open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    return replayLog.file >= 0;
+}
+
+/*
+ * StartReplayRecord
+ * Starts the record of a new game of wordLength letters and the given number
+ * of guesses on the dictionary with the given checksum, if a replay log is
+ * open, so that its turns are recorded.  Whatever the record held before is
+ * dropped.
+ */
+void StartReplayRecord(ReplayRecord& replayRecord, uint64_t dictionaryChecksum, int wordLength, int guesses) {
+    replayRecord.recording = replayLog.file >= 0;
+    if (!replayRecord.recording) return;
+    memset(&replayRecord.header, 0, sizeof(replayRecord.header));
+    replayRecord.header.dictionaryChecksum = dictionaryChecksum;
+    replayRecord.header.guesses = guesses;
+    replayRecord.header.version = REPLAY_LOG_VERSION;
+    replayRecord.header.wordLength = (uint8_t)wordLength;
+    replayRecord.turns.clear();
+}
+
+/*
+ * AddReplayTurn
+ * Adds a turn to a game's record: the letter guessed, the family key it
+ * revealed and the number of words it left in the pool.
+ */
+void AddReplayTurn(ReplayRecord& replayRecord, char guessChar, unsigned int familyKey, size_t poolWordCount) {
+    if (!replayRecord.recording) return;
+    replayRecord.turns += guessChar;
+    AppendSnapshotGap(replayRecord.turns, familyKey);
+    AppendSnapshotGap(replayRecord.turns, (uint32_t)poolWordCount);
+    replayRecord.header.guessCount++;
+}
+
+/*
+ * WriteReplayRecord
+ * Appends a game's record to the replay log, unless the game is not being
+ * recorded or no turn of it was played, and stops recording the game, so a
+ * game is written at most once however it ends.  The log is closed if it
+ * cannot be written.
+ */
+void WriteReplayRecord(ReplayRecord& replayRecord) {
+    if (!replayRecord.recording) return;
+    replayRecord.recording = false;
+    if (replayRecord.header.guessCount == 0) return;
+    pthread_mutex_lock(&replayLog.lock);
+    if (replayLog.file >= 0 &&
+        (write(replayLog.file, &replayRecord.header, sizeof(replayRecord.header)) != (ssize_t)sizeof(replayRecord.header) ||
+         write(replayLog.file, replayRecord.turns.data(), replayRecord.turns.size()) != (ssize_t)replayRecord.turns.size())) {
+        cerr << "Could not write the replay log, no longer recording" << endl;
+        close(replayLog.file);
+        replayLog.file = -1;
+    }
+    pthread_mutex_unlock(&replayLog.lock);
+}
+
+/*
+ * ReadReplayRecord
+ * Reads the header of the replay log record at position into header and
+ * moves position past the record's turns.  Returns false if the record is
+ * malformed or runs past end.
+ */
+bool ReadReplayRecord(const unsigned char*& position, const unsigned char* end, ReplayRecordHeader& header) {
+    if (end - position < (ptrdiff_t)sizeof(header)) return false;
+    memcpy(&header, position, sizeof(header));
+    position += sizeof(header);
+    if (header.version != REPLAY_LOG_VERSION || header.wordLength < 1 || header.wordLength > MAX_WORD_LENGTH ||
+        header.guessCount > ALPHABET.size() || header.guesses == 0) {
+        return false;
+    }
+    unsigned int guessedLetters = 0;
+    for (int turn = 0; turn < header.guessCount; turn++) {
+        uint32_t familyKey, poolWordCount;
+        if (position == end) return false;
+        char letter = *position++;
+        if (letter < 'a' || letter > 'z' || (guessedLetters & GetLetterBit(letter)) != 0) return false;
+        guessedLetters |= GetLetterBit(letter);
+        if (!ReadSnapshotGap(position, end, familyKey) || !ReadSnapshotGap(position, end, poolWordCount)) return false;
+    }
+    return true;
+}
+
+/*
+ * GetDefaultDictionaryFileName
+ * Returns the dictionary file used when none is given: dictionary.bin if it
+ * exists and otherwise dictionary.txt.
+ */
+string GetDefaultDictionaryFileName() {
+    struct stat compiledStatus;
+    bool compiled = stat(COMPILED_HANGMAN_DICTIONARY.c_str(), &compiledStatus) == 0;
+    return compiled ? COMPILED_HANGMAN_DICTIONARY : HANGMAN_DICTIONARY;
+}
+
+/*
+ * LoadServedDictionary
+ * Loads a version of a dictionary for the server from a compiled dictionary
+ * or, failing that, a text one, finds its word buckets and checksum and sets
+ * up and prewarms its partition cache.  The opening book is only looked for
+ * alongside the default dictionary.  Returns the version with the one
+ * reference the registry will hold, or NULL if the file cannot be read.
+ */
+LoadedDictionary* LoadServedDictionary(string fileName) {
+    LoadedDictionary* dictionary = new LoadedDictionary;
+    CompiledDictionary& compiledDictionary = dictionary->compiledDictionary;
+    if (!MapCompiledDictionary(fileName, compiledDictionary)) {
+        if (!BuildCompiledDictionary(fileName, compiledDictionary.builtData)) {
+            delete dictionary;
+            return NULL;
+        }
+        compiledDictionary.fileData = compiledDictionary.builtData.data();
+        compiledDictionary.fileSize = compiledDictionary.builtData.size();
+    }
+    compiledDictionary.bookData = NULL;
+    compiledDictionary.bookSize = 0;
+    dictionary->checksum = GetDictionaryChecksum(compiledDictionary);
+    if (fileName == HANGMAN_DICTIONARY || fileName == COMPILED_HANGMAN_DICTIONARY) MapOpeningBook(OPENING_BOOK, compiledDictionary);
+    dictionary->wordBuckets.resize(MAX_WORD_LENGTH + 1);
+    for (int wordLength = 0; wordLength <= MAX_WORD_LENGTH; wordLength++) {
+        FindCompiledWordBucket(compiledDictionary, wordLength, dictionary->wordBuckets[wordLength]);
+    }
+    InitializePartitionCache(dictionary->partitionCache, partitionCacheWords);
+    if (partitionCacheWords > 0) PrewarmPartitionCache(dictionary->wordBuckets, dictionary->partitionCache, partitionCachePrewarm);
+    dictionary->references = 1;
+    return dictionary;
+}
+
+/*
+ * FreeLoadedDictionary
+ * Frees a version of a dictionary that nothing refers to any more.
+ */
+void FreeLoadedDictionary(LoadedDictionary* dictionary) {
+    UnmapCompiledDictionary(dictionary->compiledDictionary);
+    pthread_mutex_destroy(&dictionary->partitionCache.lock);
+    delete dictionary;
+}
+
+/*
+ * GetDictionaryName
+ * Returns the name clients pick a dictionary file by: its file name without
+ * the directory or extension, so dictionary.txt and dictionary.bin are both
+ * "dictionary".
+ */
+string GetDictionaryName(string fileName) {
+    size_t nameStart = fileName.find_last_of('/');
+    nameStart = nameStart == string::npos ? 0 : nameStart + 1;
+    size_t nameEnd = fileName.find('.', nameStart);
+    return fileName.substr(nameStart, nameEnd == string::npos ? string::npos : nameEnd - nameStart);
+}
+
+/*
+ * MakeSocketAddress
+ * Takes in a server address and fills in the socket address for it.  An
+ * address made only of digits is a TCP port on the loopback interface and
+ * anything else is the path of a Unix domain socket.
+ */
+bool MakeSocketAddress(string address, sockaddr_storage& socketAddress, socklen_t& addressLength) {
+    memset(&socketAddress, 0, sizeof(socketAddress));
+    if (!address.empty() && address.find_first_not_of("0123456789") == string::npos) {
+        sockaddr_in* inetAddress = (sockaddr_in*)&socketAddress;
+        inetAddress->sin_family = AF_INET;
+        inetAddress->sin_port = htons(atoi(address.c_str()));
+        inetAddress->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addressLength = sizeof(sockaddr_in);
+        return true;
+    }
+    sockaddr_un* unixAddress = (sockaddr_un*)&socketAddress;
+    if (address.empty() || address.size() >= sizeof(unixAddress->sun_path)) return false;
+    unixAddress->sun_family = AF_UNIX;
+    strcpy(unixAddress->sun_path, address.c_str());
+    addressLength = sizeof(sockaddr_un);
+    return true;
+}
+
+/*
+ * ConnectToServer
+ * Takes in a server address and returns a blocking socket connected to it,
+ * or -1 if the connection fails.
+ */
+int ConnectToServer(string address) {
+    sockaddr_storage socketAddress;
+    socklen_t addressLength;
+    if (!MakeSocketAddress(address, socketAddress, addressLength)) return -1;
+    int connection = socket(socketAddress.ss_family, SOCK_STREAM, 0);
+    if (connection < 0) return -1;
+    if (connect(connection, (sockaddr*)&socketAddress, addressLength) != 0) {
+        close(connection);
+        return -1;
+    }
+    if (socketAddress.ss_family == AF_INET) {
+        int noDelay = 1;
+        setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    return connection;
+}
+
+#ifdef TURN_METRICS
+/*
+ * ObserveMetric
+ * Counts a value (microseconds for the timers) into a metric's histogram.
+ * Safe to call from any thread.
+ */
+void ObserveMetric(TurnMetric metric, double value) {
+    MetricHistogram& histogram = turnMetrics[metric];
+    int bucket = 0;
+    double bucketLimit = histogram.firstBucket;
+    while (value > bucketLimit && bucket < LATENCY_BUCKETS - 1) {
+        bucketLimit *= 2;
+        bucket++;
+    }
+    __sync_fetch_and_add(&histogram.buckets[bucket], 1);
+    __sync_fetch_and_add(&histogram.count, 1);
+    __sync_fetch_and_add(&histogram.sumThousandths, (long long)(value * 1000));
+}
+
+/*
+ * CountFamiliesInTable
+ * Returns the number of families counted in a family table.
+ */
+int CountFamiliesInTable(FamilyTable& familyTable) {
+    int familyCount = 0;
+    for (size_t slot = 0; slot < familyTable.slotCount; slot++) {
+        if (familyTable.counts[slot] > 0) familyCount++;
+    }
+    return familyCount;
+}
+
+/*
+ * PrintMetricsAsJSON
+ * Prints every metric as a JSON object keyed by metric name, listing the
+ * count, sum and the non-empty buckets as {"le": upper limit, "count": n}.
+ * The last bucket's limit is null since it also counts everything larger.
+ */
+void PrintMetricsAsJSON(ostream& output) {
+    output.precision(15);
+    output << "{";
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        MetricHistogram& histogram = turnMetrics[metric];
+        output << (metric > 0 ? "," : "") << "\n  \"" << histogram.name << "\": {\"help\": \"" << histogram.help
+               << "\", \"count\": " << histogram.count << ", \"sum\": " << histogram.sumThousandths / 1000.0 << ", \"buckets\": [";
+        double bucketLimit = histogram.firstBucket;
+        bool firstBucket = true;
+        for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            if (histogram.buckets[bucket] > 0) {
+                output << (firstBucket ? "" : ", ") << "{\"le\": ";
+                if (bucket < LATENCY_BUCKETS - 1) {
+                    output << bucketLimit;
+                } else {
+                    output << "null";
+                }
+                output << ", \"count\": " << histogram.buckets[bucket] << "}";
+                firstBucket = false;
+            }
+            bucketLimit *= 2;
+        }
+        output << "]}";
+    }
+    output << "\n}" << endl;
+}
+
+/*
+ * PrintMetricsAsPrometheus
+ * Prints every metric as a Prometheus histogram in the text exposition
+ * format, with cumulative buckets.
+ */
+void PrintMetricsAsPrometheus(ostream& output) {
+    output.precision(15);
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        MetricHistogram& histogram = turnMetrics[metric];
+        output << "# HELP " << histogram.name << " " << histogram.help << "\n";
+        output << "# TYPE " << histogram.name << " histogram\n";
+        long cumulativeCount = 0;
+        double bucketLimit = histogram.firstBucket;
+        for (int bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++) {
+            cumulativeCount += histogram.buckets[bucket];
+            output << histogram.name << "_bucket{le=\"" << bucketLimit << "\"} " << cumulativeCount << "\n";
+            bucketLimit *= 2;
+        }
+        output << histogram.name << "_bucket{le=\"+Inf\"} " << histogram.count << "\n";
+        output << histogram.name << "_sum " << histogram.sumThousandths / 1000.0 << "\n";
+        output << histogram.name << "_count " << histogram.count << "\n";
+    }
+    output.flush();
+}
+
+/*
+ * WriteTurnMetrics
+ * Writes the metrics to metricsPath, replacing what was there, in JSON when
+ * the path ends in .json and Prometheus text otherwise.  A path of "-" means
+ * standard error.
+ */
+void WriteTurnMetrics() {
+    if (metricsPath.empty()) return;
+    bool json = metricsPath.size() > 5 && metricsPath.compare(metricsPath.size() - 5, 5, ".json") == 0;
+    if (metricsPath == "-") {
+        PrintMetricsAsPrometheus(cerr);
+        return;
+    }
+    ofstream metricsFile(metricsPath.c_str());
+    if (!metricsFile.is_open()) {
+        cerr << "Error writing " << metricsPath << endl;
+    } else if (json) {
+        PrintMetricsAsJSON(metricsFile);
+    } else {
+        PrintMetricsAsPrometheus(metricsFile);
+    }
+}
+
+/*
+ * MetricsSignalMain
+ * The body of the metrics thread.  Waits for the signals blocked by
+ * StartMetricsExport, writing the metrics on SIGUSR1 and writing them and
+ * ending the process on SIGINT or SIGTERM.
+ */
+void* MetricsSignalMain(void* /* unused */) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    while (true) {
+        int signalNumber;
+        if (sigwait(&signals, &signalNumber) != 0) continue;
+        WriteTurnMetrics();
+        if (signalNumber != SIGUSR1) _exit(128 + signalNumber);
+    }
+    return NULL;
+}
+
+/*
+ * StartMetricsExport
+ * Arranges for the metrics to be written to path on exit and on signals.
+ * Must be called before any other thread is started, so that every thread
+ * inherits the blocked signals and only the metrics thread takes them.
+ */
+void StartMetricsExport(string path) {
+    metricsPath = path;
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_t metricsThread;
+    pthread_create(&metricsThread, NULL, MetricsSignalMain, NULL);
+    pthread_detach(metricsThread);
+    atexit(WriteTurnMetrics);
+}
+#endif
+
+/*
+ * ReadCommandOptions
+ * Takes in the command line and reads the options that may lead any command
+ * of the game or of evilHangmanBench off its front, removing them from argc
+ * and argv: first the partition tuning options -threads N, -threshold N,
+ * -cache N, -prewarm N, -strategy <name>, -depth N, -budget <milliseconds>
+ * and -deadline <milliseconds>, then -metrics <file> in a build with turn
+ * metrics, then -record <file>.  Turns are partitioned on one thread per
+ * core unless -threads says otherwise.  Returns false, having said why, if
+ * the strategy is unknown or the replay log cannot be opened.
+ */
+bool ReadCommandOptions(int& argc, char**& argv) {
+    long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+    partitionThreadCount = coreCount > 1 ? (int)coreCount : 1;
+    while (argc > 2 && (string(argv[1]) == "-threads" || string(argv[1]) == "-threshold" ||
+                        string(argv[1]) == "-cache" || string(argv[1]) == "-prewarm" ||
+                        string(argv[1]) == "-strategy" || string(argv[1]) == "-depth" || string(argv[1]) == "-budget" ||
+                        string(argv[1]) == "-deadline")) {
+        if (string(argv[1]) == "-threads") {
+            partitionThreadCount = max(1, atoi(argv[2]));
+        } else if (string(argv[1]) == "-threshold") {
+            parallelPartitionThreshold = atoi(argv[2]);
+        } else if (string(argv[1]) == "-cache") {
+            partitionCacheWords = max(0L, atol(argv[2]));
+        } else if (string(argv[1]) == "-prewarm") {
+            partitionCachePrewarm = max(0, atoi(argv[2]));
+        } else if (string(argv[1]) == "-strategy") {
+            if (!FindFamilyStrategy(argv[2], familyStrategy)) {
+                cout << "Unknown strategy " << argv[2] << endl;
+                return false;
+            }
+        } else if (string(argv[1]) == "-depth") {
+            lookaheadDepth = max(0, atoi(argv[2]));
+        } else if (string(argv[1]) == "-deadline") {
+            turnDeadline = max(0.0, atof(argv[2]) * 1e3);
+        } else {
+            lookaheadBudget = max(0.0, atof(argv[2]) * 1e3);
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+#ifdef TURN_METRICS
+    /* Metrics export: -metrics <file> may follow the tuning options */
+    if (argc > 2 && string(argv[1]) == "-metrics") {
+        StartMetricsExport(argv[2]);
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+#endif
+    
+    /* Replay log: -record <file> may follow the options above */
+    if (argc > 2 && string(argv[1]) == "-record") {
+        if (!OpenReplayLog(argv[2])) {
+            cout << "Could not open replay log " << argv[2] << endl;
+            return false;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    return true;
+}
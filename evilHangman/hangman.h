@@ -0,0 +1,869 @@
+/******************************************************
+ * File: hangman.h
+ * Author: John Yang-Sammataro
+ *
+ * Declarations of the evil hangman turn engine (see hangman.cpp),
+ * shared by the game and server (main.cpp) and the evilHangmanBench
+ * tool of benchmarks and differential checks (benchmarks.cpp).
+ */
+
+#ifndef EVIL_HANGMAN_H
+#define EVIL_HANGMAN_H
+
+/* Include libraries and header files */
+#include <iosfwd>
+#include <string>
+#include <set>
+#include <map>
+#include <vector>
+#include <deque>
+#include <list>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_FAMILY_MASK_KERNELS
+#endif
+
+/* Constants */
+const std::string HANGMAN_DICTIONARY = "dictionary.txt";
+const std::string COMPILED_HANGMAN_DICTIONARY = "dictionary.bin";
+const char COMPILED_DICTIONARY_MAGIC[4] = {'E', 'V', 'H', 'D'};
+const uint32_t COMPILED_DICTIONARY_VERSION = 2;
+/* Word sections start on this boundary in the compiled dictionary */
+const uint32_t COMPILED_SECTION_ALIGNMENT = 16;
+/* Word lists are streamed in this many blocks of this many bytes */
+const size_t INGEST_BLOCK_BYTES = 1 << 22;
+const int INGEST_BLOCKS = 4;
+const uint32_t EMPTY_WORD_SLOT = 0xFFFFFFFF;
+const std::string OPENING_BOOK = "openings.bin";
+const char OPENING_BOOK_MAGIC[4] = {'E', 'V', 'H', 'B'};
+const uint32_t OPENING_BOOK_VERSION = 1;
+/* An opening book holds one entry per ordered pair of letters per word length */
+const size_t OPENING_BOOK_TABLE_ENTRIES = 26 * 26;
+const char GAME_SNAPSHOT_MAGIC[4] = {'E', 'V', 'H', 'S'};
+const uint8_t GAME_SNAPSHOT_VERSION = 1;
+const uint8_t REPLAY_LOG_VERSION = 1;
+const int SERVER_READ_SIZE = 4096;
+/* Pools at least this large are partitioned on several threads */
+const int PARALLEL_PARTITION_THRESHOLD = 16384;
+/* Turn latency histograms start at a quarter microsecond and double */
+const int LATENCY_BUCKETS = 32;
+const double FIRST_LATENCY_BUCKET = 0.25;
+/* Letters in order of English frequency, for scripted players */
+const std::string LETTER_FREQUENCY_ORDER = "esiarntolcdupmghbyfvkwzxqj";
+/* The shared partition cache holds this many word indices in all */
+const long PARTITION_CACHE_WORDS = 1 << 22;
+/* Pools smaller than this are cheaper to partition than to look up */
+const size_t PARTITION_CACHE_MIN_POOL = 256;
+/* Opening letters whose first and second turns are cached at startup */
+const int PARTITION_CACHE_PREWARM = 6;
+/* The lookahead strategy searches this many guesses ahead in this much time a turn */
+const int LOOKAHEAD_DEPTH = 2;
+const double LOOKAHEAD_BUDGET_MICROSECONDS = 20000;
+/* Pools at least this large can have their largest family found from a sample */
+const size_t SAMPLED_FAMILY_MIN_POOL = 4096;
+/* The sample starts this large and doubles up to a quarter of the pool */
+const size_t SAMPLED_FAMILY_FIRST_SAMPLE = 256;
+/* Standard deviations the sample's largest family must lead the next by */
+const double SAMPLED_FAMILY_CONFIDENCE = 4;
+/* Server commands have no deadline unless given one with -deadline */
+const double TURN_DEADLINE_MICROSECONDS = 0;
+/* Turns with a deadline count family keys in this many interleaved passes, checking the time between them */
+const int DEADLINE_COUNT_PASSES = 8;
+/* A pool left at the search horizon is worth this many misses per halving */
+const double LOOKAHEAD_POOL_WEIGHT = 1;
+/* Pools at least this large are searched on several threads */
+const size_t LOOKAHEAD_PARALLEL_POOL = 1024;
+
+/* Scratch arena allocations start on this boundary */
+const size_t SCRATCH_ALIGNMENT = 64;
+
+const std::string ALPHABET = "abcdefghijklmnopqrstuvwxyz";
+/* Family keys hold one bit per letter position, so words must fit in 31 bits */
+const int MAX_WORD_LENGTH = 31;
+const unsigned int EMPTY_FAMILY_KEY = 0xFFFFFFFF;
+
+/* Partition tuning, set from the command line by ReadCommandOptions */
+extern int partitionThreadCount;
+extern int parallelPartitionThreshold;
+extern long partitionCacheWords;
+extern int partitionCachePrewarm;
+extern int lookaheadDepth;
+extern double lookaheadBudget;
+extern double turnDeadline;
+
+#if defined(COUNT_ALLOCATIONS) || defined(TURN_METRICS)
+/* Every operator new in the process and the bytes it asked for (see hangman.cpp) */
+extern long allocationCount;
+extern long allocatedBytes;
+#endif
+
+#ifdef TURN_METRICS
+/*
+ * Built with -DTURN_METRICS, the dictionary load, the steps of a turn and the
+ * whole turn are timed and the turns' pool sizes, families and allocations
+ * are counted into histograms (see MetricHistogram).  "-metrics <file>" in
+ * front of any command writes them to the file (JSON if it ends in .json,
+ * Prometheus text otherwise, "-" for standard error) on exit and whenever the
+ * process gets SIGUSR1.  Otherwise the hooks below compile to nothing.
+ */
+#define METRIC_TIMER(timer) double timer = GetMicroseconds()
+#define METRIC_OBSERVE_TIME(metric, timer) ObserveMetric(metric, GetMicroseconds() - (timer))
+#define METRIC_OBSERVE(metric, value) ObserveMetric(metric, value)
+#define METRIC_ALLOCATION_MARK(mark) long mark = allocatedBytes
+#define METRIC_OBSERVE_ALLOCATION(metric, mark) ObserveMetric(metric, allocatedBytes - (mark))
+#else
+#define METRIC_TIMER(timer)
+#define METRIC_OBSERVE_TIME(metric, timer)
+#define METRIC_OBSERVE(metric, value)
+#define METRIC_ALLOCATION_MARK(mark)
+#define METRIC_OBSERVE_ALLOCATION(metric, mark)
+#endif
+
+/* Types */
+
+/*
+ * OpeningBookHeader, OpeningBookEntry
+ * Layout of openings.bin, written by "-book", all fields in native byte
+ * order.  The header is followed by a table of 26 * 26 entries for every word
+ * length from 0 to MAX_WORD_LENGTH.  Entry first * 26 + second of a length's
+ * table is the greedy result of guessing letter first and then letter second
+ * on a new game, and entry first * 27 (second being first) that of guessing
+ * letter first alone: the family key each guess narrowed the pool to and the
+ * words left.  The words themselves are not stored, since they are just the
+ * pool's words whose letter mask matches the family key.  dictionaryChecksum
+ * is the GetDictionaryChecksum of the dictionary the book was built from.
+ */
+struct OpeningBookHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t dictionaryChecksum;
+    uint32_t fileSize;
+    uint32_t reserved;
+};
+
+struct OpeningBookEntry {
+    uint32_t firstFamilyKey;
+    uint32_t secondFamilyKey;
+    uint32_t wordCount;
+};
+
+/*
+ * WordBucket
+ * Every dictionary word of a single length packed back to back, so word i
+ * starts at words[i * wordLength].  The candidate pool for a game is a list
+ * of indices into the bucket rather than copies of the words.  words points
+ * into the loaded compiled dictionary, and openingBook into the length's table
+ * of the opening book (NULL without one).  wordsChecksum is the HashBytes of
+ * the words, which game snapshots are checked against since their pools are
+ * indices into them.
+ *
+ * letterMasks is the bucket's letter position index: one column of wordCount
+ * family keys per letter a-z, so the family of word i for a letter is just
+ * letterMasks[letter * wordCount + i] and a turn streams through one column.
+ *
+ * letterBits holds the same index as bitsets over the bucket, for pools kept
+ * as CandidateBits: for each letter a-z, wordLength + 1 rows of blockCount
+ * 64 bit blocks, where bit i of row p is set when word i has the letter at
+ * position p, and of row wordLength when it has the letter anywhere.
+ */
+struct WordBucket {
+    int wordLength;
+    int wordCount;
+    int blockCount;
+    const char* words;
+    uint64_t wordsChecksum;
+    std::vector<unsigned int> letterMasks;
+    std::vector<uint64_t> letterBits;
+    const OpeningBookEntry* openingBook;
+};
+
+/*
+ * CandidateBits
+ * A candidate pool kept as a bitset over its word bucket rather than as a
+ * list of indices: bit i of blocks (blockCount 64 bit blocks) is set when
+ * word i is still possible, and wordCount is the number of bits set.  Sizing
+ * a family is then an AND/ANDNOT chain of the pool with the bucket's
+ * letterBits rows and a popcount, and the whole pool is a few KB whatever its
+ * size.  Only blocks firstBlock to endBlock - 1 may be nonzero.  Narrowing
+ * the pool shrinks that range to its first and last nonzero blocks, so later
+ * turns only scan the stretch of the bucket the pool still spans, which the
+ * order of the compiled dictionary keeps short.
+ */
+struct CandidateBits {
+    std::vector<uint64_t> blocks;
+    int firstBlock;
+    int endBlock;
+    int wordCount;
+};
+
+/*
+ * CandidateSplit
+ * The state of FindLargestFamilyInBits as it splits a pool on the guess char
+ * one position at a time.  A node of the split is kept sparsely as the
+ * indices and bits of its nonzero blocks, in one of two slots of blockCount
+ * entries per depth (for its two children), and a branch is dropped as soon
+ * as it holds fewer words than the largest family found so far.
+ */
+struct CandidateSplit {
+    WordBucket* wordBucket;
+    char guessChar;
+    int* blockIndices;
+    uint64_t* blockBits;
+    unsigned int largestFamilyKey;
+    int largestFamilySize;
+};
+
+/*
+ * FamilyMaskKernel
+ * A routine that makes the family key of every word in a packed bucket for
+ * one guess char.  Kernels for several instruction sets are chosen between at
+ * runtime and must all give the same keys.
+ */
+typedef void (*FamilyMaskFunction)(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys);
+
+struct FamilyMaskKernel {
+    const char* name;
+    FamilyMaskFunction makeFamilyKeys;
+};
+
+/*
+ * WordLengthKernels
+ * The loops over a word's characters, compiled once for every word length
+ * with the length fixed so each is fully unrolled (see UnrolledWord), and
+ * looked up in WORD_LENGTH_KERNELS by word length.  makeFamilyKeys is a
+ * family mask kernel for buckets of that length, addLetterMasks and
+ * addLetterBits fill a bucket's letterMasks and letterBits indexes,
+ * revealFamily writes the guess char into a pattern at its family key's
+ * positions and hasBlank tells whether a pattern still has a blank.
+ */
+typedef void (*LengthFamilyKeysFunction)(const char* words, int wordCount, char guessChar, unsigned int* familyKeys);
+typedef void (*AddLetterMasksFunction)(const char* words, int wordCount, unsigned int* letterMasks);
+typedef void (*AddLetterBitsFunction)(const char* words, int wordCount, int blockCount, uint64_t* letterBits);
+typedef void (*RevealFamilyFunction)(unsigned int familyKey, char* pattern, char guessChar);
+typedef bool (*HasBlankFunction)(const char* pattern);
+
+struct WordLengthKernels {
+    LengthFamilyKeysFunction makeFamilyKeys;
+    AddLetterMasksFunction addLetterMasks;
+    AddLetterBitsFunction addLetterBits;
+    RevealFamilyFunction revealFamily;
+    HasBlankFunction hasBlank;
+};
+
+/*
+ * FamilyKeyStream
+ * Match bits of a bucket's byte matrix waiting to be cut into family keys of
+ * wordLength bits by the vector kernels.
+ */
+struct FamilyKeyStream {
+    uint64_t bits;
+    int bitCount;
+    int wordLength;
+    uint64_t keyMask;
+    unsigned int* nextFamilyKey;
+};
+
+/*
+ * ScratchArena
+ * A bump allocator for the working space of a turn.  Allocations are carved
+ * from one block in order and all released at once by a reset, so a turn's
+ * buffers sit next to each other and cost nothing to free.  The block only
+ * grows, and only on a reset, when nothing carved from it is still in use.
+ */
+struct ScratchArena {
+    std::vector<char> memory;
+    size_t used;
+};
+
+/*
+ * FamilyTable
+ * A flat open addressed table counting words per family key.  Empty slots
+ * hold EMPTY_FAMILY_KEY.  The table is sized to at least twice the number of
+ * keys it will be given, so probes stay short.  Its slots live in a scratch
+ * arena.
+ */
+struct FamilyTable {
+    int tableBits;
+    size_t slotCount;
+    unsigned int* keys;
+    int* counts;
+};
+
+/*
+ * PartitionChunk
+ * One thread's share of a parallel partition: the range [begin, end) of the
+ * possible words, its own family histogram, and where its members of the
+ * winning family go in the narrowed pool.  countedAll is false if the turn's
+ * deadline (or 0) cut its count short.
+ */
+struct PartitionChunk {
+    WordBucket* wordBucket;
+    std::vector<int>* possibleWords;
+    unsigned int* familyKeys;
+    int* familyWords;
+    char guessChar;
+    size_t begin;
+    size_t end;
+    double deadline;
+    bool countedAll;
+    FamilyTable familyTable;
+    unsigned int largestFamilyKey;
+    size_t familyOffset;
+};
+
+/*
+ * LookaheadFamily, LookaheadLevel
+ * A pool split by one letter for the lookahead search.  families holds each
+ * family's key and its range of words, largest family first, and words holds
+ * the pool's word indices grouped by family in their original order.  The
+ * search keeps a level per ply, so a family's words stay put while the
+ * family's subtree is searched.
+ */
+struct LookaheadFamily {
+    unsigned int familyKey;
+    size_t begin;
+    size_t size;
+};
+
+struct LookaheadLevel {
+    ScratchArena arena;
+    FamilyTable familyTable;
+    std::vector<int> words;
+    std::vector<LookaheadFamily> families;
+};
+
+/*
+ * LookaheadBound, LookaheadMemoEntry
+ * A searched state's value at a depth, whether it is exact or only a bound
+ * (when the search window cut the state short), and the player's best reply,
+ * which is tried first when the state is searched again one depth deeper.
+ */
+enum LookaheadBound {
+    LOOKAHEAD_EXACT,
+    LOOKAHEAD_LOWER_BOUND,
+    LOOKAHEAD_UPPER_BOUND
+};
+
+struct LookaheadMemoEntry {
+    int depth;
+    double value;
+    LookaheadBound bound;
+    char bestLetter;
+};
+
+/*
+ * LookaheadSearch
+ * One turn's lookahead search, shared by the threads searching it.  The pool
+ * is split by the guess into rootLevel's families, which the threads claim
+ * one at a time through nextFamily and search depth guesses deep, leaving
+ * their values in familyValues.  A thread that finds the deadline passed sets
+ * aborted, and that depth's values are thrown away.  horizonReached records
+ * whether any state was cut off by the depth rather than solved, and
+ * completedDepth the deepest depth searched in full (all of them once the
+ * game tree is solved).
+ */
+struct LookaheadSearch {
+    WordBucket* wordBucket;
+    LookaheadLevel rootLevel;
+    std::string rootPattern;
+    unsigned int rootGuessedLetters;
+    char guessChar;
+    int depth;
+    double deadline;
+    volatile bool aborted;
+    volatile bool horizonReached;
+    volatile int nextFamily;
+    std::vector<double> familyValues;
+    int completedDepth;
+};
+
+/*
+ * LookaheadWorker
+ * One thread's share of a lookahead search: a level per ply, the revealed
+ * pattern of the state it is searching and its memo of searched states,
+ * keyed by pattern and guessed letters and kept for the whole turn.  States
+ * under different root families have different patterns, so the threads
+ * never need each other's memos.
+ */
+struct LookaheadWorker {
+    LookaheadSearch* search;
+    std::vector<LookaheadLevel> levels;
+    std::string pattern;
+    std::map<std::string, LookaheadMemoEntry> memo;
+    long nodes;
+};
+
+/*
+ * PartitionScratch
+ * Working space for FindLargestWordFamily, owned by whatever thread plays
+ * the turns (the interactive game, each server worker and each simulation
+ * thread) rather than by the games, which only keep their pools between
+ * turns.  Every turn resets the arena and carves its buffers from it, so once
+ * ReservePartitionScratch has sized it for the largest pool turns never
+ * allocate.  familyTable is the last turn's table.  The lookahead strategy
+ * keeps its search here as well, and candidateWords holds a CandidateBits
+ * pool listed out for a strategy that needs a list.  turnDeadline is when
+ * the turn being played must be answered by, in GetMicroseconds time, or 0
+ * if it has no deadline; the entry points to the strategies set it.
+ */
+struct PartitionScratch {
+    ScratchArena arena;
+    FamilyTable familyTable;
+    std::vector<PartitionChunk> chunks;
+    std::vector<pthread_t> threads;
+    LookaheadSearch lookaheadSearch;
+    std::vector<LookaheadWorker> lookaheadWorkers;
+    std::vector<int> candidateWords;
+    double turnDeadline;
+};
+
+/*
+ * FamilyStrategy
+ * How the computer picks the family a guess narrows the pool to.  chooseFamily
+ * has the contract of FindLargestWordFamily (it narrows possibleWords in place
+ * and returns the family key), and is also given the revealed pattern and the
+ * letters guessed before guessChar.  chooseFamilyInBits does the same for a
+ * pool kept as CandidateBits, or is NULL if the strategy needs the pool as a
+ * list.  Strategies are chosen between with "-strategy".
+ */
+typedef unsigned int (*ChooseFamilyFunction)(char guessChar, WordBucket& wordBucket, std::vector<int>& possibleWords, std::string& guessedWord, std::string& charactersGuessed, PartitionScratch& partitionScratch);
+typedef unsigned int (*ChooseFamilyInBitsFunction)(char guessChar, WordBucket& wordBucket, CandidateBits& candidateBits, std::string& guessedWord, std::string& charactersGuessed, PartitionScratch& partitionScratch);
+
+struct FamilyStrategy {
+    const char* name;
+    ChooseFamilyFunction chooseFamily;
+    ChooseFamilyInBitsFunction chooseFamilyInBits;
+};
+
+/*
+ * CompiledDictionaryHeader, CompiledBucketEntry
+ * Layout of dictionary.bin, all fields in native byte order.  The header is
+ * followed by bucketCount entries (the length index, in increasing length)
+ * and then by each length's words packed at a fixed stride of wordLength
+ * bytes starting at wordsOffset, in the order of DictionaryWordOrder.
+ */
+struct CompiledDictionaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t bucketCount;
+    uint32_t fileSize;
+};
+
+struct CompiledBucketEntry {
+    uint32_t wordLength;
+    uint32_t wordCount;
+    uint32_t wordsOffset;
+    uint32_t reserved;
+};
+
+/*
+ * CompiledDictionary
+ * The dictionary in the compiled format, held in one contiguous block:
+ * either a read-only memory mapping of dictionary.bin or, without it, the
+ * same image built from the text dictionary into builtData.  Word buckets
+ * handed out from it point straight into the block.  bookData is a mapping
+ * of the opening book built from this dictionary, or NULL.
+ */
+struct CompiledDictionary {
+    const char* fileData;
+    size_t fileSize;
+    std::string builtData;
+    const char* bookData;
+    size_t bookSize;
+};
+
+/*
+ * DictionaryWord
+ * A word of the text dictionary as a view into the text it was read from,
+ * with its GetWordSignature.
+ */
+struct DictionaryWord {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t signature;
+};
+
+/*
+ * DictionaryWordOrder
+ * Orders dictionary words by length, then by signature and then
+ * alphabetically, the order of the compiled dictionary.  Sorting a length's
+ * words by the letters they hold, most frequent letter first, keeps the
+ * words that evil turns leave together (all the words without e, then those
+ * without e or s, and so on) in runs, so the pools of later turns sit in a
+ * few stretches of the bucket rather than being strewn across it.  With
+ * bySignature false the order is plain alphabetical, for comparison.
+ */
+struct DictionaryWordOrder {
+    const char* text;
+    bool bySignature;
+    bool operator()(const DictionaryWord& word, const DictionaryWord& otherWord) const {
+        if (word.length != otherWord.length) return word.length < otherWord.length;
+        if (bySignature && word.signature != otherWord.signature) return word.signature < otherWord.signature;
+        return std::memcmp(text + word.offset, text + otherWord.offset, word.length) < 0;
+    }
+};
+
+/*
+ * IngestBlock, IngestQueue
+ * A block of a word list being streamed in, holding whole lines only, and a
+ * queue handing blocks from one ingestion stage to the next.  wordOffsets
+ * lists where the words the validation stage accepted start.  A NULL block
+ * marks the end of the file.
+ */
+struct IngestBlock {
+    std::vector<char> data;
+    size_t size;
+    std::vector<uint32_t> wordOffsets;
+};
+
+struct IngestQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t blockReady;
+    std::deque<IngestBlock*> blocks;
+};
+
+/*
+ * WordHashSet
+ * The set of distinct words kept so far, as an open addressed table of
+ * indices into the kept words, which have a fixed stride.  Empty slots hold
+ * EMPTY_WORD_SLOT.  Four bytes a slot and at most half full, it is far
+ * smaller than a tree of strings.
+ */
+struct WordHashSet {
+    std::vector<uint32_t> slots;
+    size_t count;
+};
+
+/*
+ * DictionaryIngest
+ * State shared by the stages of StreamDictionaryBucket.  Blocks go round
+ * from freeBlocks to the reader, to validation through validateQueue, to
+ * keepQueue and back, so a file of any size is read in INGEST_BLOCKS blocks.
+ * Only the words of wordLength are kept, in bucketText, so memory grows with
+ * that bucket rather than with the file.  Each counter is written by one
+ * stage only.
+ */
+struct DictionaryIngest {
+    int fileDescriptor;
+    int wordLength;
+    std::vector<IngestBlock> blocks;
+    IngestQueue freeBlocks;
+    IngestQueue validateQueue;
+    IngestQueue keepQueue;
+    std::string bucketText;
+    WordHashSet keptWords;
+    long long bytesRead;
+    long linesRead;
+    long rejectedWords;
+    long duplicateWords;
+};
+
+/*
+ * HangmanGame
+ * The state owned by a single game.  The word bucket its possibleWords index
+ * into is shared read-only with every other game of the same length, and its
+ * turns are played in the partition scratch of whichever thread plays them.
+ */
+struct HangmanGame {
+    int wordLength;
+    int guessesRemaining;
+    std::string guessedWord;
+    std::string charactersGuessed;
+    std::vector<int> possibleWords;
+};
+
+/*
+ * GameSnapshotHeader
+ * The start of a game snapshot made by SaveHangmanGame, all fields in native
+ * byte order.  It is followed by the guessCount letters guessed, in the order
+ * they were guessed, and then by the pool in one of two encodings, whichever
+ * is smaller: a bitset over the length bucket (one bit per word, bit i of
+ * byte i / 8 for word i) or the gaps between the pool's word indices in
+ * increasing order as variable length integers (seven bits a byte, low bits
+ * first, the high bit set on all but the last byte).  The revealed pattern is
+ * not stored, since it is any pool word with the unguessed letters hidden.
+ * wordsChecksum is that of the word bucket the pool indexes into.
+ */
+enum SnapshotPoolEncoding {
+    SNAPSHOT_POOL_BITS,
+    SNAPSHOT_POOL_GAPS
+};
+
+struct GameSnapshotHeader {
+    char magic[4];
+    uint8_t version;
+    uint8_t wordLength;
+    uint8_t poolEncoding;
+    uint8_t guessCount;
+    uint32_t guessesRemaining;
+    uint32_t poolWordCount;
+    uint64_t wordsChecksum;
+};
+
+/*
+ * ReplayRecordHeader, ReplayRecord, ReplayLog
+ * A replay log is a file of game records back to back, appended to as games
+ * are played with "-record <file>".  A record is a ReplayRecordHeader, all
+ * fields in native byte order, followed for each of its guessCount turns by
+ * the letter guessed and then the family key the turn revealed and the size
+ * of the pool it left, those two as variable length integers like a
+ * snapshot's pool gaps.  dictionaryChecksum is the GetDictionaryChecksum of
+ * the dictionary the game was played on and guesses the number of guesses
+ * it started with.  A game's record is built up in a ReplayRecord while the
+ * game is played (recording is false for games that are not recorded) and
+ * written out whole, under the log's lock, when it ends.  file is -1 while
+ * nothing is recorded.
+ */
+struct ReplayRecordHeader {
+    uint64_t dictionaryChecksum;
+    uint32_t guesses;
+    uint8_t version;
+    uint8_t wordLength;
+    uint8_t guessCount;
+    uint8_t reserved;
+};
+
+struct ReplayRecord {
+    bool recording;
+    ReplayRecordHeader header;
+    std::string turns;
+};
+
+struct ReplayLog {
+    int file;
+    pthread_mutex_t lock;
+};
+
+/*
+ * CachedFamily, PartitionCache
+ * A bounded least recently used cache of turn results shared by every game
+ * of a server or simulation.  A game's candidate pool is fixed by its word
+ * length, revealed pattern and set of guessed letters, so those and the new
+ * guess char key the winning family key and the narrowed pool.  entries is
+ * kept most recently used first, and the least recently used are dropped
+ * once the cached pools hold more than wordCapacity indices in all.
+ */
+struct CachedFamily {
+    std::string cacheKey;
+    unsigned int familyKey;
+    std::vector<int> familyWords;
+};
+
+struct PartitionCache {
+    pthread_mutex_t lock;
+    std::list<CachedFamily> entries;
+    std::map<std::string, std::list<CachedFamily>::iterator> entryIndex;
+    size_t wordCapacity;
+    size_t wordCount;
+    long hits;
+    long misses;
+};
+
+#ifdef TURN_METRICS
+/*
+ * TurnMetric, MetricHistogram
+ * One histogram per metric, with buckets that start at firstBucket and double
+ * like the simulation's latency histogram.  Updates are atomic adds, so any
+ * thread can observe a metric without a lock, and sum is kept in thousandths
+ * so it can be added to atomically as well.
+ */
+enum TurnMetric {
+    METRIC_DICTIONARY_LOAD,
+    METRIC_INITIALIZE_POSSIBLE_WORDS,
+    METRIC_MAKE_WORD_FAMILY_KEYS,
+    METRIC_COUNT_LARGEST_FAMILY,
+    METRIC_TURN,
+    METRIC_POOL_BEFORE_GUESS,
+    METRIC_POOL_AFTER_GUESS,
+    METRIC_FAMILIES_GENERATED,
+    METRIC_TURN_BYTES_ALLOCATED,
+    METRIC_COUNT
+};
+
+struct MetricHistogram {
+    const char* name;
+    const char* help;
+    double firstBucket;
+    long count;
+    long long sumThousandths;
+    long buckets[LATENCY_BUCKETS];
+};
+#endif
+
+/*
+ * LoadedDictionary
+ * One version of a dictionary the server hosts: the compiled dictionary, the
+ * word buckets found in it and the partition cache of turns played on it,
+ * which only hold for this version.  Nothing but the cache changes once a
+ * version is published.  checksum is its GetDictionaryChecksum, which games
+ * on it are recorded with.  references counts the registry (while the
+ * version is current) and every session with a game on it, and the reloader
+ * frees the version once that reaches 0.
+ */
+struct LoadedDictionary {
+    CompiledDictionary compiledDictionary;
+    uint64_t checksum;
+    std::vector<WordBucket> wordBuckets;
+    PartitionCache partitionCache;
+    volatile long references;
+};
+
+/* Family choosing strategies, the first of them the default */
+extern const FamilyStrategy FAMILY_STRATEGIES[];
+
+/* Word length kernels for every length up to MAX_WORD_LENGTH, by length */
+extern const WordLengthKernels WORD_LENGTH_KERNELS[MAX_WORD_LENGTH + 1];
+
+/* The strategy turns are played with, set from the command line by ReadCommandOptions */
+extern FamilyStrategy familyStrategy;
+
+/* The replay log games are recorded to, opened from the command line by ReadCommandOptions */
+extern ReplayLog replayLog;
+
+/* Function Prototypes */
+double GetMicroseconds();
+void OpenFile(std::ifstream& input, std::string fileName);
+void ReadDictionary(std::ifstream& dictionaryFile, std::string& dictionaryText, std::vector<DictionaryWord>& dictionaryWords);
+uint32_t GetWordSignature(const char* word, int wordLength);
+void InitializeGuessedWord(int wordLength, std::string& guessedWord);
+bool BuildCompiledDictionary(std::string dictionaryFileName, std::string& compiledData);
+void LayOutCompiledDictionary(const std::string& dictionaryText, std::vector<DictionaryWord>& dictionaryWords, std::string& compiledData);
+bool CompileDictionary(std::string dictionaryFileName, std::string compiledFileName);
+void InitializeIngestQueue(IngestQueue& ingestQueue);
+void PushIngestBlock(IngestQueue& ingestQueue, IngestBlock* block);
+IngestBlock* PopIngestBlock(IngestQueue& ingestQueue);
+bool LowercaseWord(char* word, int wordLength);
+uint32_t HashWord(const char* word, int wordLength);
+bool InsertDistinctWord(WordHashSet& wordHashSet, const char* words, int wordLength, uint32_t wordIndex);
+void* ValidateIngestBlocks(void* ingestPointer);
+void* KeepIngestedWords(void* ingestPointer);
+bool StreamDictionaryBucket(std::string fileName, int wordLength, DictionaryIngest& ingest);
+void LoadDictionary(CompiledDictionary& compiledDictionary);
+bool MapCompiledDictionary(std::string compiledFileName, CompiledDictionary& compiledDictionary);
+void UnmapCompiledDictionary(CompiledDictionary& compiledDictionary);
+uint64_t GetDictionaryChecksum(CompiledDictionary& compiledDictionary);
+uint64_t HashBytes(const char* bytes, size_t byteCount);
+bool BuildOpeningBook(std::string dictionaryFileName, std::string bookFileName);
+bool MapOpeningBook(std::string bookFileName, CompiledDictionary& compiledDictionary);
+void ReadCompiledWordLengths(CompiledDictionary& compiledDictionary, std::set<int>& wordLengths);
+void FindCompiledWordBucket(CompiledDictionary& compiledDictionary, int wordLength, WordBucket& wordBucket);
+void InitializePossibleWordIndices(WordBucket& wordBucket, std::vector<int>& possibleWords);
+const char* GetBucketWord(WordBucket& wordBucket, int wordIndex);
+void BuildLetterMaskIndex(WordBucket& wordBucket);
+const unsigned int* GetLetterMaskColumn(WordBucket& wordBucket, char guessChar);
+void BuildLetterBitIndex(WordBucket& wordBucket);
+const uint64_t* GetLetterBitRow(WordBucket& wordBucket, char letter, int position);
+void InitializeCandidateBits(WordBucket& wordBucket, CandidateBits& candidateBits);
+int GetFirstCandidate(CandidateBits& candidateBits);
+void ListCandidateBits(CandidateBits& candidateBits, std::vector<int>& possibleWords);
+void SetCandidateBits(WordBucket& wordBucket, std::vector<int>& possibleWords, CandidateBits& candidateBits);
+unsigned int MakeFamilyKey(const char* word, int wordLength, char guessChar);
+void AppendFamilyKeyBits(FamilyKeyStream& familyKeyStream, unsigned int matchBits, int bitCount);
+void AppendFamilyKeyTail(FamilyKeyStream& familyKeyStream, const char* words, size_t byteOffset, size_t byteCount, char guessChar);
+void InitializeFamilyKeyStream(FamilyKeyStream& familyKeyStream, int wordLength, unsigned int* familyKeys);
+void MakeBucketFamilyKeysScalar(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys);
+#ifdef HAVE_X86_FAMILY_MASK_KERNELS
+void MakeBucketFamilyKeysSSE2(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys);
+void MakeBucketFamilyKeysAVX2(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys);
+#endif
+std::vector<FamilyMaskKernel> GetSupportedFamilyMaskKernels();
+FamilyMaskFunction SelectFamilyMaskKernel();
+template <int Length> void MakeLengthFamilyKeys(const char* words, int wordCount, char guessChar, unsigned int* familyKeys);
+template <int Length> void AddLengthLetterMasks(const char* words, int wordCount, unsigned int* letterMasks);
+template <int Length> void AddLengthLetterBits(const char* words, int wordCount, int blockCount, uint64_t* letterBits);
+template <int Length> void RevealLengthFamily(unsigned int familyKey, char* pattern, char guessChar);
+template <int Length> bool HasLengthBlank(const char* pattern);
+void MakeBucketFamilyKeysUnrolled(const char* words, int wordLength, int wordCount, char guessChar, unsigned int* familyKeys);
+void AddLetterMasksGeneric(const char* words, int wordLength, int wordCount, unsigned int* letterMasks);
+void AddLetterBitsGeneric(const char* words, int wordLength, int wordCount, int blockCount, uint64_t* letterBits);
+void RevealFamilyGeneric(unsigned int familyKey, char* pattern, int wordLength, char guessChar);
+bool HasBlankGeneric(const char* pattern, int wordLength);
+void MakeWordFamilyKeys(WordBucket& wordBucket, std::vector<int>& possibleWords, char guessChar, unsigned int* familyKeys);
+bool IsFamilyKeyBefore(unsigned int familyKey, unsigned int otherFamilyKey);
+void ResetScratchArena(ScratchArena& scratchArena, size_t capacity);
+void* AllocateScratch(ScratchArena& scratchArena, size_t bytes);
+size_t GetFamilyTableSlots(size_t keyCount);
+void AllocateFamilyTable(FamilyTable& familyTable, size_t keyCount, ScratchArena& scratchArena);
+void ClearFamilyTable(FamilyTable& familyTable);
+void InitializeFamilyTable(FamilyTable& familyTable, size_t keyCount, ScratchArena& scratchArena);
+unsigned int FindFamilySlot(FamilyTable& familyTable, unsigned int familyKey);
+void AddToFamilyTable(FamilyTable& familyTable, unsigned int familyKey, int count);
+unsigned int FindLargestFamilyInTable(FamilyTable& familyTable);
+bool CountFamilyKeys(const unsigned int* familyKeys, size_t keyCount, FamilyTable& familyTable, double deadline);
+unsigned int CountLargestFamily(const unsigned int* familyKeys, size_t keyCount, FamilyTable& familyTable, ScratchArena& scratchArena, double deadline);
+void* CountFamilyChunk(void* chunkPointer);
+void* ScatterFamilyChunk(void* chunkPointer);
+void RunPartitionChunks(PartitionScratch& partitionScratch, void* (*chunkMain)(void*));
+size_t GetPartitionScratchBytes(size_t poolSize, int chunkCount);
+void ReservePartitionScratch(PartitionScratch& partitionScratch, size_t poolSize);
+unsigned int FindLargestWordFamilyInParallel(char guessChar, WordBucket& wordBucket, std::vector<int>& possibleWords, PartitionScratch& partitionScratch, int threadCount, double deadline);
+unsigned int FindLargestWordFamily(char guessChar, WordBucket& wordBucket, std::vector<int>& possibleWords, PartitionScratch& partitionScratch);
+unsigned int FindLargestWordFamilyByDeadline(char guessChar, WordBucket& wordBucket, std::vector<int>& possibleWords, PartitionScratch& partitionScratch, double deadline);
+const OpeningBookEntry* FindOpeningBookEntry(WordBucket& wordBucket, size_t poolSize, std::string& guessedWord, std::string& charactersGuessed, char guessChar);
+void NarrowToWordFamily(WordBucket& wordBucket, std::vector<int>& possibleWords, char guessChar, unsigned int familyKey);
+unsigned int ChooseLargestWordFamily(char guessChar, WordBucket& wordBucket, std::vector<int>& possibleWords, std::string& guessedWord, std::string& charactersGuessed, PartitionScratch& partitionScratch);
+unsigned int FindSampledWordFamily(char guessChar, WordBucket& wordBucket, std::vector<int>& possibleWords, PartitionScratch& partitionScratch);
+unsigned int ChooseSampledWordFamily(char guessChar, WordBucket& wordBucket, std::vector<int>& possibleWords, std::string& guessedWord, std::string& charactersGuessed, PartitionScratch& partitionScratch);
+size_t GetCandidateSplitBytes(WordBucket& wordBucket);
+void SplitCandidateBits(CandidateSplit& split, int depth, size_t nodeSlot, int nodeBlocks, int nodeWords, unsigned int familyKey);
+void NarrowCandidateBits(WordBucket& wordBucket, CandidateBits& candidateBits, char guessChar, unsigned int familyKey);
+unsigned int FindLargestFamilyInBits(char guessChar, WordBucket& wordBucket, CandidateBits& candidateBits, PartitionScratch& partitionScratch);
+unsigned int ChooseLargestFamilyInBits(char guessChar, WordBucket& wordBucket, CandidateBits& candidateBits, std::string& guessedWord, std::string& charactersGuessed, PartitionScratch& partitionScratch);
+unsigned int ChooseCandidateFamily(char guessChar, WordBucket& wordBucket, CandidateBits& candidateBits, std::string& guessedWord, std::string& charactersGuessed, PartitionScratch& partitionScratch);
+unsigned int GetLetterBit(char letter);
+unsigned int GetGuessedLetters(std::string& charactersGuessed);
+void SetPatternLetter(std::string& pattern, unsigned int familyKey, char letter);
+bool IsLookaheadFamilyBefore(const LookaheadFamily& family, const LookaheadFamily& otherFamily);
+void SplitLookaheadPool(WordBucket& wordBucket, const int* words, size_t wordCount, char letter, bool groupWords, LookaheadLevel& level);
+double GetLookaheadPoolValue(size_t wordCount);
+double SearchLookaheadState(LookaheadWorker& worker, const int* words, size_t wordCount, unsigned int guessedLetters, int depth, double alpha, double beta);
+void* LookaheadWorkerMain(void* workerPointer);
+void RunLookaheadWorkers(PartitionScratch& partitionScratch, int workerCount);
+size_t FindBestLookaheadFamily(LookaheadSearch& lookaheadSearch);
+unsigned int ChooseLookaheadWordFamily(char guessChar, WordBucket& wordBucket, std::vector<int>& possibleWords, std::string& guessedWord, std::string& charactersGuessed, PartitionScratch& partitionScratch);
+bool FindFamilyStrategy(std::string strategyName, FamilyStrategy& strategy);
+void UpdateGuessedWordAndCharactersGuessed(unsigned int familyKey, std::string& guessedWord, std::string& charactersGuessed, char guessChar);
+bool IsWordGuessed(std::string& guessedWord);
+void LoadWordBuckets(CompiledDictionary& compiledDictionary, std::vector<WordBucket>& wordBuckets);
+bool StartHangmanGame(std::vector<WordBucket>& wordBuckets, int wordLength, int guesses, HangmanGame& game);
+size_t GetLargestWordBucketSize(std::vector<WordBucket>& wordBuckets);
+unsigned int PlayHangmanGuess(std::vector<WordBucket>& wordBuckets, HangmanGame& game, char guessChar, PartitionScratch& partitionScratch, PartitionCache* partitionCache, double deadline);
+void InitializePartitionCache(PartitionCache& partitionCache, size_t wordCapacity);
+std::string MakePartitionCacheKey(HangmanGame& game, char guessChar);
+bool FindCachedFamily(PartitionCache& partitionCache, std::string& cacheKey, std::vector<int>& possibleWords, unsigned int& familyKey);
+void AddCachedFamily(PartitionCache& partitionCache, std::string& cacheKey, unsigned int familyKey, std::vector<int>& familyWords);
+void PrewarmPartitionCache(std::vector<WordBucket>& wordBuckets, PartitionCache& partitionCache, int openingLetters);
+std::string DescribePartitionCache(PartitionCache& partitionCache);
+std::string DescribeHangmanGame(std::vector<WordBucket>& wordBuckets, HangmanGame& game);
+void AppendSnapshotGap(std::string& snapshot, uint32_t gap);
+bool ReadSnapshotGap(const unsigned char*& position, const unsigned char* end, uint32_t& gap);
+void SaveHangmanGame(WordBucket& wordBucket, HangmanGame& game, std::string& snapshot);
+bool RestoreHangmanGame(std::vector<WordBucket>& wordBuckets, const std::string& snapshot, HangmanGame& game);
+std::string EncodeHex(const std::string& bytes);
+bool DecodeHex(const std::string& text, std::string& bytes);
+bool OpenReplayLog(std::string fileName);
+void StartReplayRecord(ReplayRecord& replayRecord, uint64_t dictionaryChecksum, int wordLength, int guesses);
+void AddReplayTurn(ReplayRecord& replayRecord, char guessChar, unsigned int familyKey, size_t poolWordCount);
+void WriteReplayRecord(ReplayRecord& replayRecord);
+bool ReadReplayRecord(const unsigned char*& position, const unsigned char* end, ReplayRecordHeader& header);
+std::string GetDefaultDictionaryFileName();
+LoadedDictionary* LoadServedDictionary(std::string fileName);
+void FreeLoadedDictionary(LoadedDictionary* dictionary);
+std::string GetDictionaryName(std::string fileName);
+bool MakeSocketAddress(std::string address, sockaddr_storage& socketAddress, socklen_t& addressLength);
+int ConnectToServer(std::string address);
+#ifdef TURN_METRICS
+void ObserveMetric(TurnMetric metric, double value);
+int CountFamiliesInTable(FamilyTable& familyTable);
+void PrintMetricsAsJSON(std::ostream& output);
+void PrintMetricsAsPrometheus(std::ostream& output);
+void WriteTurnMetrics();
+void* MetricsSignalMain(void* unused);
+void StartMetricsExport(std::string path);
+#endif
+bool ReadCommandOptions(int& argc, char**& argv);
+
+#endif
@@ -15,6 +15,64 @@
  * to the same directory as the Xcode project. This can be done
  * by going in Xcode to Product->Edit Scheme->Options(tab) and
  * checking "Use custom directory"
+ *
+ * This file holds the interactive game, the game server and the command
+ * line.  The turn engine they play through is in hangman.cpp (declared in
+ * hangman.h), which the evilHangmanBench tool of benchmarks and
+ * differential checks (see benchmarks.cpp) is built from as well.
+ *
+ * Running "evilHangman -compile" once turns dictionary.txt into the
+ * binary dictionary.bin, which later games map into memory instead of
+ * parsing the text file.  Without dictionary.bin the text file is read.
+ *
+ * "evilHangman -book [dictionary] [book]" likewise precomputes the greedy
+ * result of every one and two letter opening into openings.bin, which later
+ * games look their first two guesses up in as long as it was built from the
+ * dictionary they load.  "evilHangmanBench -checkbook" checks it against
+ * live turns.
+ *
+ * "evilHangman -ingest <word list> <length> [compiled file]" streams the
+ * words of one length out of a word list too large to read whole, reports
+ * MB/s and can write them out as a one length compiled dictionary.
+ *
+ * "evilHangman -pipe" plays games read from standard input back to back,
+ * for piping scripted games through one process, and reports games per
+ * second on standard error.
+ *
+ * "evilHangman -serve <port or socket path> [dictionary files]" hosts many
+ * games at once over a line protocol (see HandleSessionCommand), on any of
+ * the dictionaries given, each reloaded when its file changes, and
+ * "evilHangmanBench -loadtest <address> [clients] [games]" drives it with
+ * simulated players.  "-deadline N" in front of -serve gives every command
+ * N milliseconds from its arrival to be answered: a turn still unplayed at
+ * its deadline is given the sampled strategy's cheaper answer, and a family
+ * count or lookahead search still running at it is cut short and gives the
+ * best answer it has (see PlayHangmanGuess).
+ *
+ * Large candidate pools are partitioned on one thread per core, except
+ * where games already run on one thread per core (the server and
+ * multithreaded simulations and replays), which partition each turn on the
+ * thread playing it.  "-threads N" and "-threshold N" in front of any
+ * command change the thread count and the smallest pool partitioned in
+ * parallel (see ReadCommandOptions for all the leading options).
+ *
+ * "-record <file>" in front of the game, -pipe or -serve appends a record
+ * of every game played to a replay log (see ReplayRecordHeader), which
+ * "evilHangmanBench -replay" plays again and checks.
+ *
+ * The server shares one cache of partitioned turns between all its games.
+ * "-cache N" in front of it bounds it to N cached word indices (0 turns it
+ * off) and "-prewarm N" caches the first two turns for the N most frequent
+ * letters at startup.
+ *
+ * "-strategy lookahead" in front of any command replaces the greedy choice
+ * of the largest word family with a minimax search that looks "-depth N"
+ * guesses ahead within "-budget N" milliseconds a turn.  "-strategy
+ * sampled" keeps the greedy choice but estimates the largest family of
+ * large pools from a sample of their words.
+ *
+ * Building with -DTURN_METRICS adds timing and size histograms for loading
+ * and turns, exported with "-metrics <file>" (see TurnMetric).
  */
 
 /* Include libraries and header files */
@@ -24,74 +82,282 @@
 #include <sstream>
 #include <set>
 #include <map>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "hangman.h"
 using namespace std;
 
 /* Constants */
-const string HANGMAN_DICTIONARY = "dictionary.txt";
-const string ALPHABET = "abcdefghijklmnopqrstuvwxyz";
+/* Standard input is read this many bytes at a time */
+const size_t INPUT_BUFFER_BYTES = 1 << 16;
+const int SERVER_BACKLOG = 1024;
+/* The server checks its dictionary files for changes this often */
+const useconds_t DICTIONARY_RELOAD_INTERVAL_MICROSECONDS = 1000000;
+const useconds_t DICTIONARY_GRACE_POLL_MICROSECONDS = 100;
+
+/* Types */
+
+/*
+ * InputBuffer
+ * Standard input read in blocks of up to INPUT_BUFFER_BYTES, with the unread
+ * bytes from start to end.  line is reused for every line read, so that
+ * prompting does not allocate once it has grown to the longest line.  closed
+ * is set once the input has ended.
+ */
+struct InputBuffer {
+    char data[INPUT_BUFFER_BYTES];
+    size_t start;
+    size_t end;
+    bool closed;
+    string line;
+};
+
+/*
+ * ServedDictionary
+ * A dictionary in the server's registry: the name clients pick it by, the
+ * file it is loaded from, that file's status when it was last loaded and the
+ * current version.  Only the reloader writes current, and it swaps in a new
+ * version without a lock (see ReloadServedDictionaries).
+ */
+struct ServedDictionary {
+    string name;
+    string fileName;
+    struct stat fileStatus;
+    LoadedDictionary* volatile current;
+};
+
+/*
+ * GameSession
+ * One client connection to the game server.  Bytes read from the socket wait
+ * in input until a full line arrives and responses wait in output until the
+ * socket accepts them.  A session is handed to at most one worker at a time
+ * (busy), so its game never needs a lock.  dictionary is the version of the
+ * dictionary the game was started on, which the session holds a reference
+ * to, or NULL, and replayRecord the game's record for the replay log.
+ */
+struct GameSession {
+    int socket;
+    string input;
+    string output;
+    bool busy;
+    bool closing;
+    bool hasGame;
+    HangmanGame game;
+    LoadedDictionary* dictionary;
+    ReplayRecord replayRecord;
+};
+
+/*
+ * SessionJob
+ * A command line from a session waiting for, or answered by, a worker.
+ * deadline is when it must be answered by, or 0 if it has no deadline.
+ */
+struct SessionJob {
+    GameSession* session;
+    string command;
+    string response;
+    double deadline;
+};
+
+/*
+ * GameServer
+ * State shared by the server's event loop and its worker pool.  Jobs are
+ * queued under lock for the workers, and answered jobs come back through
+ * finishedJobs with a byte written to wakePipe to wake the event loop.
+ * dictionaries is the registry of hosted dictionaries, fixed once the server
+ * starts.  workerEpochs[i] is odd while worker i is answering a job, which
+ * is when it may read a dictionary's current version, and retiredDictionaries
+ * holds replaced versions that games may still be on; both are for the
+ * reloader.
+ */
+struct GameServer {
+    vector<ServedDictionary> dictionaries;
+    vector<LoadedDictionary*> retiredDictionaries;
+    vector<long> workerEpochs;
+    volatile int nextWorker;
+    pthread_mutex_t lock;
+    pthread_cond_t jobReady;
+    deque<SessionJob> pendingJobs;
+    deque<SessionJob> finishedJobs;
+    int wakePipe[2];
+    bool stopping;
+};
 
 /* Function Prototypes */
+bool FillInputBuffer(InputBuffer& input);
+bool ReadInputLine(InputBuffer& input);
+bool HasMoreInput(InputBuffer& input);
+const string& ReadStandardInputLine();
+const char* SkipSpaces(const char* text);
 string GetLine();
 char GetAlphabetCharacter();
 int GetInteger();
 int GetPositiveInteger();
-void OpenFile(ifstream& input, string fileName);
-void ReadDictionary(ifstream& dictionaryFile, set<string>& dictionarySet, set<int>& wordLengths);
 void PromptForWordLength(set<int>& dictionaryWordLengths, int& wordLength);
-void InitializeGuessedWord(int wordLength, string& guessedWord);
-void InitializePossibleWords(int worldLength, set<string>& dictionarySet, set<string>& possibleWords);
+void InitializePossibleWords(int wordLength, CompiledDictionary& compiledDictionary, WordBucket& wordBucket, CandidateBits& candidateBits);
 void PromptForGuessesRemaining(int wordLength, int& guessesRemaining);
 void PromptForDisplayOfNumberOfWordsRemaining(bool& displayNumberOfWordsRemaining);
 bool PromptForYesOrNo();
-void InitializeHangmanGame(ifstream& dictionaryFile, set<string>& dictionarySet, set<int>& dictionaryWordLengths, int& wordLength, string& guessedWord, set<string>& possibleWords, int& guessesRemaining, bool& displayNumberOfWordsRemaining);
+void InitializeHangmanGame(CompiledDictionary& compiledDictionary, set<int>& dictionaryWordLengths, int& wordLength, string& guessedWord, WordBucket& wordBucket, CandidateBits& candidateBits, PartitionScratch& partitionScratch, int& guessesRemaining, bool& displayNumberOfWordsRemaining);
 void PrintWordSpaceDelinated(string word);
 void PrintGuessesRemaining(int guessesRemaining);
-void PrintWordsRemaining(set<string>& possibleWords, bool displayNumberOfWordsRemaining);
+void PrintWordsRemaining(CandidateBits& candidateBits, bool displayNumberOfWordsRemaining);
 char PromptForCharacterGuess(string& charactersGuessed);
-map<string, set<string> > MakeWordFamilyMap(set<string>& possibleWords, char guessChar);
-set<string> CountLargestFamily(map<string, set<string> >& wordFamilyMap);
-set<string> FindLargestWordFamily(char guessChar, set<string> possibleWords);
-void UpdateGuessesRemaining(set<string>& newPossibleWords, int& guessesRemaining, char guessChar, string& guessedWord);
-void UpdateGuessedWordAndCharactersGuessed(set<string>& newPossibleWords, string& guessedWord, string& charactersGuessed, char guessChar);
-bool IsWordGuessed(string guessedWord);
-void EndTurn (set<string>& possibleWords, int guessesRemaining, int wordLength, string guessedWord, bool& gameCompleted);
-void PlayTurn(int wordLength, string& guessedWord, set<string>& possibleWords, int& guessesRemaining, string& charactersGuessed, bool displayNumberOfWordsRemaining);
+void UpdateGuessesRemaining(unsigned int familyKey, int& guessesRemaining, char guessChar);
+void EndTurn (WordBucket& wordBucket, CandidateBits& candidateBits, int guessesRemaining, int wordLength, string guessedWord, bool& gameCompleted);
+void PlayTurn(int wordLength, string& guessedWord, WordBucket& wordBucket, CandidateBits& candidateBits, PartitionScratch& partitionScratch, int& guessesRemaining, string& charactersGuessed, bool displayNumberOfWordsRemaining, ReplayRecord& replayRecord);
+ServedDictionary* FindServedDictionary(GameServer& server, string name);
+LoadedDictionary* AcquireServedDictionary(ServedDictionary& servedDictionary);
+void ReleaseLoadedDictionary(LoadedDictionary* dictionary);
+bool IsSameFile(struct stat& fileStatus, struct stat& otherFileStatus);
+void WaitForServerWorkers(GameServer& server);
+void ReloadServedDictionaries(GameServer& server);
+void* DictionaryReloaderMain(void* serverPointer);
+string HandleSessionCommand(GameServer& server, PartitionScratch& partitionScratch, GameSession& session, string command, double deadline);
+bool SetNonBlocking(int socket);
+int OpenServerSocket(string address);
+void* ServerWorkerMain(void* serverPointer);
+void DispatchSessionLine(GameServer& server, GameSession& session);
+int RunGameServer(string address, vector<string>& dictionaryFileNames);
+int RunDictionaryIngest(string fileName, int wordLength, string compiledFileName);
+int RunPipedGames();
+
+/* Everything the game prompts for is read through this */
+InputBuffer standardInput;
 
 /* Functions */
 
+/*
+ * FillInputBuffer
+ * Takes in an input buffer with no unread bytes left and reads the next block
+ * of standard input into it.  Anything written to cout is flushed first, since
+ * this is where the game waits for its player, so a prompt is always on screen
+ * before the read blocks while a script piped in gets its output in large
+ * writes.  Returns false once the input has ended.
+ */
+bool FillInputBuffer(InputBuffer& input) {
+    if (input.closed) return false;
+    cout.flush();
+    ssize_t bytesRead;
+    do {
+        bytesRead = read(STDIN_FILENO, input.data, INPUT_BUFFER_BYTES);
+    } while (bytesRead < 0 && errno == EINTR);
+    input.start = 0;
+    input.end = bytesRead > 0 ? bytesRead : 0;
+    input.closed = bytesRead <= 0;
+    return !input.closed;
+}
+
+/*
+ * ReadInputLine
+ * Takes in an input buffer by reference and reads its next line, without the
+ * newline, into input.line.  Like getline, a last line with no newline is
+ * still read, and false is returned only when the input has ended.
+ */
+bool ReadInputLine(InputBuffer& input) {
+    input.line.clear();
+    while (true) {
+        if (input.start == input.end && !FillInputBuffer(input)) {
+            return !input.line.empty();
+        }
+        const char* lineStart = input.data + input.start;
+        const char* newline = (const char*)memchr(lineStart, '\n', input.end - input.start);
+        if (newline != NULL) {
+            input.line.append(lineStart, newline - lineStart);
+            input.start += newline - lineStart + 1;
+            return true;
+        }
+        input.line.append(lineStart, input.end - input.start);
+        input.start = input.end;
+    }
+}
+
+/*
+ * HasMoreInput
+ * Skips the whitespace at the front of an input buffer and returns whether
+ * anything is left after it, that is whether another game can be read.
+ */
+bool HasMoreInput(InputBuffer& input) {
+    while (true) {
+        if (input.start == input.end && !FillInputBuffer(input)) return false;
+        while (input.start < input.end && isspace((unsigned char)input.data[input.start])) {
+            input.start++;
+        }
+        if (input.start < input.end) return true;
+    }
+}
+
+/*
+ * ReadStandardInputLine
+ * Returns the next line of standard input.  There is nothing left to prompt
+ * for once the input has ended, so the output is flushed and the program
+ * exits there.
+ */
+const string& ReadStandardInputLine() {
+    if (!ReadInputLine(standardInput)) {
+        cout.flush();
+        exit(0);
+    }
+    return standardInput.line;
+}
+
+/*
+ * SkipSpaces
+ * Returns a pointer to the first character of the null terminated text that
+ * is not whitespace.
+ */
+const char* SkipSpaces(const char* text) {
+    while (*text != '\0' && isspace((unsigned char)*text)) {
+        text++;
+    }
+    return text;
+}
+
 /* 
  * GetLine:
  * Takes in a line from the user and returns a string.
  * Safer than just using a getline(cin, str); function
  */
 string GetLine() {
-    string buffer;
-    getline(cin, buffer);
-    return buffer;
+    return ReadStandardInputLine();
 }
 
 /*
  * GetAlphabetCharacter
  * Prompts until the user enters a character in the
  * English alphabet and returns that character in lowercase.
+ * The line is parsed in place in the shared input buffer.
  */
 char GetAlphabetCharacter() {
     while (true) {
-        stringstream converter;
-        converter << GetLine();
-        char resultChar;
-        converter >> resultChar;
-        resultChar = tolower(resultChar);
+        const char* text = SkipSpaces(ReadStandardInputLine().c_str());
+        char resultChar = tolower(*text);
         
-        if(ALPHABET.find(resultChar) != -1) {
-            char remaining;
-            if (converter >> remaining) {
-                cout << "Unexpected character: " << remaining << endl;
+        if(resultChar != '\0' && ALPHABET.find(resultChar) != -1) {
+            char remaining = *SkipSpaces(text + 1);
+            if (remaining != '\0') {
+                cout << "Unexpected character: " << remaining << '\n';
             } else {
                 return resultChar;
             }
         } else {
-            cout << "Please enter a character in the alphabet." << endl;
+            cout << "Please enter a character in the alphabet." << '\n';
         }
         cout << "Retry: ";
     }
@@ -100,24 +366,25 @@ char GetAlphabetCharacter() {
 /* 
  * GetInteger:
  * Takes in an integer and prompts until a valid integer is inputed
- * by the user.
+ * by the user.  The line is parsed in place in the shared input buffer.
  */
 int GetInteger() {
     while(true) {
-        stringstream converter;
-        converter << GetLine();
-        int resultInt;
+        const char* text = ReadStandardInputLine().c_str();
+        char* integerEnd;
+        errno = 0;
+        long resultInt = strtol(text, &integerEnd, 10);
         /* Check if an int is entered correctly */
-        if(converter >> resultInt) {
+        if(integerEnd != text && errno == 0 && resultInt >= INT_MIN && resultInt <= INT_MAX) {
             /*Check for extraneous input */
-            char remaining;
-            if(converter >> remaining) {
-                cout << "Unexpected character: " << remaining << endl;
+            char remaining = *SkipSpaces(integerEnd);
+            if(remaining != '\0') {
+                cout << "Unexpected character: " << remaining << '\n';
             } else {
-                return resultInt;
+                return (int)resultInt;
             }
         } else {
-            cout << "Please enter an integer." << endl;
+            cout << "Please enter an integer." << '\n';
         }
         cout << "Retry: ";
     }    
@@ -134,43 +401,12 @@ int GetPositiveInteger() {
         if(integer > 0) {
             return integer;
         } else {
-            cout << "Not a positive integer." << endl;
+            cout << "Not a positive integer." << '\n';
             cout << "Please enter a positive integer: ";
         }
     }
 }
 
-/*
- * OpenFile
- * Takes in a filestream by reference and a
- * file name.  Opens the file if is valid and
- * throws an exception otherwise.
- */
-void OpenFile(ifstream& input, string fileName) {
-    input.open(fileName.c_str());
-    if(!input.is_open()) {
-        cout << "Error reading " << fileName << endl;
-        input.clear();
-    }
-}
-
-/*
- * ReadDictionary
- * Takes in a dictionaryFile filestream, a dictionarySet string set,
- * and a wordlengths integer set all by reference.  The function then
- * reads in words from the dictionaryFile into the dictionarySet and 
- * keeps track of what word lengths have been read with thie the integer
- * wordLengths set.
- */
-void ReadDictionary(ifstream& dictionaryFile, set<string>& dictionarySet, set<int>& wordLengths) {
-    string word;
-    while(!dictionaryFile.eof()) {
-        getline(dictionaryFile, word);
-        dictionarySet.insert(word);
-        wordLengths.insert((int)word.size());
-    }
-}
-
 /*
  * PromptForWordLength
  * Takes in an integer set (by reference for efficiency) and wordLength by reference.
@@ -185,38 +421,23 @@ void PromptForWordLength(set<int>& dictionaryWordLengths, int& wordLength) {
         if (dictionaryWordLengths.count(wordLength)) {
             return;
         } else {
-            cout << "Sorry, no words exist with that length in this dictionary." << endl;
+            cout << "Sorry, no words exist with that length in this dictionary." << '\n';
         }
     }
 }
 
-/*
- * MakeGuessedWord
- * Takes in a an integer word length by value and string by reference and
- * converts the string into a string of a number of "_" (underscore) characters
- * equal to the word length.
- */
-void InitializeGuessedWord(int wordLength, string& guessedWord) {
-    string result = "";
-    for (size_t i = 0; i < wordLength; i++) {
-        result += "_";
-    }
-    guessedWord = result;
-    
-}
-
 /*
  * InitializePossibleWords
- * Takes in an integer wordLength by value, a dictionary string set by reference
- * (for efficiency), and string set of possible words by reference.  It then sets
- * the possibleWords set to all the words in the dictionary that have the word length.
- */
-void InitializePossibleWords(int wordLength, set<string>& dictionarySet, set<string>& possibleWords) {
-    for(set<string>::iterator wordItr = dictionarySet.begin(); wordItr != dictionarySet.end(); wordItr ++) {
-        if(wordItr->size() == wordLength) {
-            possibleWords.insert(*wordItr);
-        }
-    }
+ * Takes in an integer wordLength by value, the loaded dictionary, a word
+ * bucket and a candidate pool by reference.  It points the bucket at the
+ * dictionary's words with the word length (in the compiled dictionary's
+ * signature order, see DictionaryWordOrder) and sets the pool to all of them.
+ */
+void InitializePossibleWords(int wordLength, CompiledDictionary& compiledDictionary, WordBucket& wordBucket, CandidateBits& candidateBits) {
+    METRIC_TIMER(initializeStart);
+    FindCompiledWordBucket(compiledDictionary, wordLength, wordBucket);
+    InitializeCandidateBits(wordBucket, candidateBits);
+    METRIC_OBSERVE_TIME(METRIC_INITIALIZE_POSSIBLE_WORDS, initializeStart);
 }
 
 /*
@@ -247,7 +468,7 @@ void PromptForGuessesRemaining(int wordLength, int& guessesRemaining) {
  * with yes and false with no.
  */
 void PromptForDisplayOfNumberOfWordsRemaining(bool& displayNumberOfWordsRemaining) {
-    cout << "Would you like to know the number of possible words left after each guess?" << endl;
+    cout << "Would you like to know the number of possible words left after each guess?" << '\n';
     displayNumberOfWordsRemaining = PromptForYesOrNo();
 }
 
@@ -281,7 +502,7 @@ bool PromptForYesOrNo() {
             
             return false;
         } else {
-            cout << "Invalid input.  Please try again." << endl;
+            cout << "Invalid input.  Please try again." << '\n';
         }
     }
 }
@@ -289,15 +510,17 @@ bool PromptForYesOrNo() {
 /*
  * InitializeHangmanGame
  * Takes in the state parameters for the hangman game by reference and calls upon
- * helper functions to initialize the hangman game.
+ * helper functions to initialize the hangman game.  The dictionary is loaded
+ * by LoadDictionary.
  */
-void InitializeHangmanGame(ifstream& dictionaryFile, set<string>& dictionarySet, set<int>& dictionaryWordLengths, int& wordLength, string& guessedWord, set<string>& possibleWords, int& guessesRemaining, bool& displayNumberOfWordsRemaining) {
+void InitializeHangmanGame(CompiledDictionary& compiledDictionary, set<int>& dictionaryWordLengths, int& wordLength, string& guessedWord, WordBucket& wordBucket, CandidateBits& candidateBits, PartitionScratch& partitionScratch, int& guessesRemaining, bool& displayNumberOfWordsRemaining) {
     
-    OpenFile(dictionaryFile, HANGMAN_DICTIONARY);
-    ReadDictionary(dictionaryFile, dictionarySet, dictionaryWordLengths);
+    LoadDictionary(compiledDictionary);
+    ReadCompiledWordLengths(compiledDictionary, dictionaryWordLengths);
     PromptForWordLength(dictionaryWordLengths, wordLength);
     InitializeGuessedWord(wordLength, guessedWord);
-    InitializePossibleWords(wordLength, dictionarySet, possibleWords);
+    InitializePossibleWords(wordLength, compiledDictionary, wordBucket, candidateBits);
+    ReservePartitionScratch(partitionScratch, wordBucket.wordCount);
     PromptForGuessesRemaining(wordLength, guessesRemaining);
     PromptForDisplayOfNumberOfWordsRemaining(displayNumberOfWordsRemaining);
     
@@ -312,7 +535,7 @@ void PrintWordSpaceDelinated(string word) {
     for (size_t i = 0; i < word.size(); i++) {
         cout << word[i] << " ";
     }
-    cout << endl;
+    cout << '\n';
 }
 
 /*
@@ -321,19 +544,19 @@ void PrintWordSpaceDelinated(string word) {
  * and prints out the number with an appropriate message.
  */
 void PrintGuessesRemaining(int guessesRemaining) {
-    cout << "You have " << guessesRemaining << " guesses remaining." << endl;
+    cout << "You have " << guessesRemaining << " guesses remaining." << '\n';
 }
 
 /*
  * PrintWordsRemaining
- * Takes inthe possible words string set (by reference for efficiency)
+ * Takes in the candidate pool (by reference for efficiency)
  * and the displayNumberOfWordsRemaining boolean.  If the boolean is true
- * the function prints out the size of the set.  Otherwise, the function
+ * the function prints out the number of words.  Otherwise, the function
  * does not have any effect.
  */
-void PrintWordsRemaining(set<string>& possibleWords, bool displayNumberOfWordsRemaining) {
+void PrintWordsRemaining(CandidateBits& candidateBits, bool displayNumberOfWordsRemaining) {
     if(displayNumberOfWordsRemaining) {
-        cout << "There are " << possibleWords.size() << " possible words left." << endl;
+        cout << "There are " << candidateBits.wordCount << " possible words left." << '\n';
     } else {
         //Do nothing
     }
@@ -343,207 +566,706 @@ void PrintWordsRemaining(set<string>& possibleWords, bool displayNumberOfWordsRe
  * PromptForCharacterGuess
  * Takes in the charactersGuessed string by reference and prompts the user to
  * enter another character until they enter a character in the alphabet that 
- * has not already been guessed.  It then adds that character to the characters
- * guessed and returns the character.
+ * has not already been guessed.  It then returns the character, which the
+ * turn adds to the characters guessed once it has been played.
  */
 char PromptForCharacterGuess(string& charactersGuessed) {
     while (true) {
         cout << "Please guess a letter: ";
         char guessChar = GetAlphabetCharacter();
         if(charactersGuessed.find(guessChar) == -1) {
-            charactersGuessed += guessChar;
             return guessChar;
         }
-        cout << "The letter " << guessChar << " has already been guessed." << endl;
+        cout << "The letter " << guessChar << " has already been guessed." << '\n';
     }
 }
 
 /*
- * MakeWordFamilyMap
- * Takes in a set of string possible words by reference for efficiency and a guess 
- * character. Then makes a map of string sets of word families based on occurances
- * of the guess char within the words. For instance, with guess char 'e'
- * "else"-> e__e. The function then returns the map of string set<string> pairs.
+ * UpdateGuessesRemaining
+ * Processes the player guess by taking in the family key of the new possible
+ * words and determining if the player guessed a correct letter (an empty key
+ * means the family does not contain the letter). It then updates the guesses
+ * remaining accordingly, printing appropriate messages to the player.
  */
-map<string, set<string> > MakeWordFamilyMap(set<string>& possibleWords, char guessChar) {
-    map<string, set<string> > wordFamilyMap;
-    for(set<string>::iterator wordPtr = possibleWords.begin(); wordPtr != possibleWords.end(); wordPtr++) {
-        string familyType = "";
-        for (int i = 0; i < wordPtr->size(); i++) {
-            if (wordPtr->at(i) == guessChar) {
-                familyType += guessChar;
-            } else {
-                familyType += '_';
-            }
+void UpdateGuessesRemaining(unsigned int familyKey, int& guessesRemaining, char guessChar) {
+    if (familyKey == 0) {
+        cout << "Sorry, incorrect guess. ";
+        PrintGuessesRemaining(--guessesRemaining);
+    } else {
+        cout << "Correct! The word contains " << guessChar << "." << '\n';
+    }
+}
+
+/*
+ * EndTurn
+ * Ends the player turn by taking in the word bucket and possible words, the guessesRemaining, wordLength,
+ * string of the guessedWord and the boolean for the game completion. It then determines whether
+ * the game has ended and prints out appropriate messages to the player before signaling by
+ * chaing the boolean, to end the while loop.
+ */
+void EndTurn (WordBucket& wordBucket, CandidateBits& candidateBits, int guessesRemaining, int wordLength, string guessedWord, bool& gameCompleted) {
+    if (IsWordGuessed(guessedWord)) {
+        cout << "Congratulations! You WIN!" << '\n';
+        cout << "The word is ";
+        PrintWordSpaceDelinated(guessedWord);
+        gameCompleted = true;
+    } else if (guessesRemaining == 0) {
+        cout << "Sorry, you lose. The word is: " << '\n';
+        PrintWordSpaceDelinated(string(GetBucketWord(wordBucket, GetFirstCandidate(candidateBits)), wordLength));
+        gameCompleted = true;
+    } else {
+        //Do nothing
+    }
+}
+
+void PlayTurn(int wordLength, string& guessedWord, WordBucket& wordBucket, CandidateBits& candidateBits, PartitionScratch& partitionScratch, int& guessesRemaining, string& charactersGuessed, bool displayNumberOfWordsRemaining, ReplayRecord& replayRecord) {
+    
+    /* Update player */
+    PrintGuessesRemaining(guessesRemaining);
+    PrintWordSpaceDelinated(guessedWord);
+    PrintWordsRemaining(candidateBits, displayNumberOfWordsRemaining);
+    
+    /* Guessing character */
+    char guessChar = PromptForCharacterGuess(charactersGuessed);
+    METRIC_TIMER(turnStart);
+    METRIC_OBSERVE(METRIC_POOL_BEFORE_GUESS, candidateBits.wordCount);
+    METRIC_ALLOCATION_MARK(turnBytes);
+    unsigned int familyKey = ChooseCandidateFamily(guessChar, wordBucket, candidateBits, guessedWord, charactersGuessed, partitionScratch);
+    
+    UpdateGuessesRemaining(familyKey, guessesRemaining, guessChar);
+    UpdateGuessedWordAndCharactersGuessed(familyKey, guessedWord, charactersGuessed, guessChar);
+    METRIC_OBSERVE(METRIC_POOL_AFTER_GUESS, candidateBits.wordCount);
+    METRIC_OBSERVE_ALLOCATION(METRIC_TURN_BYTES_ALLOCATED, turnBytes);
+    METRIC_OBSERVE_TIME(METRIC_TURN, turnStart);
+    AddReplayTurn(replayRecord, guessChar, familyKey, candidateBits.wordCount);
+}
+
+/*
+ * FindServedDictionary
+ * Returns the server's dictionary with the given name, the first one for an
+ * empty name, or NULL if it hosts none by that name.
+ */
+ServedDictionary* FindServedDictionary(GameServer& server, string name) {
+    for (size_t i = 0; i < server.dictionaries.size(); i++) {
+        if (name.empty() || server.dictionaries[i].name == name) return &server.dictionaries[i];
+    }
+    return NULL;
+}
+
+/*
+ * AcquireServedDictionary, ReleaseLoadedDictionary
+ * Take and drop a reference to a dictionary's current version, for a game
+ * to be played on.  Neither locks.  Acquiring is only safe on a worker while
+ * it answers a job, since the reloader waits for those jobs to end before
+ * dropping the registry's reference to a version it has replaced.
+ */
+LoadedDictionary* AcquireServedDictionary(ServedDictionary& servedDictionary) {
+    LoadedDictionary* dictionary = servedDictionary.current;
+    __sync_fetch_and_add(&dictionary->references, 1);
+    return dictionary;
+}
+
+void ReleaseLoadedDictionary(LoadedDictionary* dictionary) {
+    if (dictionary != NULL) __sync_fetch_and_sub(&dictionary->references, 1);
+}
+
+/*
+ * IsSameFile
+ * Returns whether two stat results are of the same, unchanged file.  A file
+ * renamed over the old one has a new inode, and one rewritten in place a new
+ * modification time or size.
+ */
+bool IsSameFile(struct stat& fileStatus, struct stat& otherFileStatus) {
+#ifdef __APPLE__
+    struct timespec& modified = fileStatus.st_mtimespec;
+    struct timespec& otherModified = otherFileStatus.st_mtimespec;
+#else
+    struct timespec& modified = fileStatus.st_mtim;
+    struct timespec& otherModified = otherFileStatus.st_mtim;
+#endif
+    return fileStatus.st_ino == otherFileStatus.st_ino && fileStatus.st_dev == otherFileStatus.st_dev &&
+           fileStatus.st_size == otherFileStatus.st_size &&
+           modified.tv_sec == otherModified.tv_sec && modified.tv_nsec == otherModified.tv_nsec;
+}
+
+/*
+ * WaitForServerWorkers
+ * Waits until every worker that was answering a job when called has
+ * finished it.  Workers are never stopped or slowed down: the reloader
+ * only watches their epochs change.
+ */
+void WaitForServerWorkers(GameServer& server) {
+    vector<long> startEpochs(server.workerEpochs.size());
+    for (size_t i = 0; i < startEpochs.size(); i++) {
+        startEpochs[i] = __sync_fetch_and_add(&server.workerEpochs[i], 0);
+    }
+    for (size_t i = 0; i < startEpochs.size(); i++) {
+        while (startEpochs[i] % 2 == 1 && __sync_fetch_and_add(&server.workerEpochs[i], 0) == startEpochs[i]) {
+            usleep(DICTIONARY_GRACE_POLL_MICROSECONDS);
         }
-        if (wordFamilyMap.count(familyType)) {
-            // operator[] returns a reference to the map element. Important for efficiency
-            wordFamilyMap[familyType].insert(*wordPtr);
+    }
+}
+
+/*
+ * ReloadServedDictionaries
+ * Called on the reloader thread.  Loads a new version of every dictionary
+ * whose file has changed since it was loaded and publishes it with an atomic
+ * swap of the current pointer, so games started from then on get the new
+ * version while games in progress carry on with the version they started
+ * on.  Once the workers have finished the jobs that could have read the old
+ * pointer, the registry's reference to the old version is dropped, and
+ * versions no game refers to any more are freed.  Turns never wait on any of
+ * it.  A file that cannot be read (say, halfway through being written)
+ * keeps the current version until the next check.  Compiled dictionaries
+ * are mapped rather than copied, so they must be replaced by renaming a new
+ * file over the old one rather than rewritten in place.
+ */
+void ReloadServedDictionaries(GameServer& server) {
+    for (size_t i = 0; i < server.dictionaries.size(); i++) {
+        ServedDictionary& servedDictionary = server.dictionaries[i];
+        struct stat fileStatus;
+        if (stat(servedDictionary.fileName.c_str(), &fileStatus) != 0 || IsSameFile(fileStatus, servedDictionary.fileStatus)) continue;
+        double loadStart = GetMicroseconds();
+        LoadedDictionary* dictionary = LoadServedDictionary(servedDictionary.fileName);
+        if (dictionary == NULL) continue;
+        double loadMilliseconds = (GetMicroseconds() - loadStart) / 1000;
+        servedDictionary.fileStatus = fileStatus;
+        LoadedDictionary* oldDictionary = servedDictionary.current;
+        __sync_bool_compare_and_swap(&servedDictionary.current, oldDictionary, dictionary);
+        double graceStart = GetMicroseconds();
+        WaitForServerWorkers(server);
+        ReleaseLoadedDictionary(oldDictionary);
+        server.retiredDictionaries.push_back(oldDictionary);
+        cout << "Reloaded " << servedDictionary.name << " from " << servedDictionary.fileName << " in " << loadMilliseconds
+             << " ms, old version retired after " << (GetMicroseconds() - graceStart) / 1000 << " ms" << endl;
+    }
+    vector<LoadedDictionary*>& retiredDictionaries = server.retiredDictionaries;
+    for (size_t i = 0; i < retiredDictionaries.size(); ) {
+        if (__sync_fetch_and_add(&retiredDictionaries[i]->references, 0) == 0) {
+            FreeLoadedDictionary(retiredDictionaries[i]);
+            retiredDictionaries[i] = retiredDictionaries.back();
+            retiredDictionaries.pop_back();
         } else {
-            set<string> familySet;
-            familySet.insert(*wordPtr);
-            wordFamilyMap[familyType] = familySet; 
+            i++;
         }
     }
-    return wordFamilyMap;
 }
 
 /*
- * CountLargestWordFamily
- * Takes in a wordFamily map of strings to string sets by reference for efficiency
- * and counts the families returning the largest string set word family.
+ * DictionaryReloaderMain
+ * The body of the reloader thread, which checks the server's dictionary
+ * files for changes every DICTIONARY_RELOAD_INTERVAL_MICROSECONDS.  It runs
+ * at the lowest priority the scheduler offers (SCHED_IDLE where there is
+ * one), so loading a new version only takes time the workers leave idle.
  */
-set<string> CountLargestFamily(map<string, set<string> >& wordFamilyMap) {
-    set<string> largestWordFamily;
-    for (map<string, set<string> >::iterator pairItr = wordFamilyMap.begin(); pairItr != wordFamilyMap.end(); pairItr++) {
-        set<string> wordFamily = pairItr->second;
-        if (wordFamily.size() > largestWordFamily.size()) largestWordFamily = wordFamily;
+void* DictionaryReloaderMain(void* serverPointer) {
+    GameServer& server = *(GameServer*)serverPointer;
+    struct sched_param schedulingParameters;
+    memset(&schedulingParameters, 0, sizeof(schedulingParameters));
+#ifdef SCHED_IDLE
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &schedulingParameters);
+#else
+    schedulingParameters.sched_priority = sched_get_priority_min(SCHED_OTHER);
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &schedulingParameters);
+#endif
+    while (!server.stopping) {
+        usleep(DICTIONARY_RELOAD_INTERVAL_MICROSECONDS);
+        ReloadServedDictionaries(server);
     }
-    return largestWordFamily;
+    return NULL;
 }
 
 /*
- * FindLargestWordFamily
- * A recursive function that takes in a character guesssed, a set of poossible
- * word strings, an integer wordLength, and an integer wordIndex whose default is
- * 0. The function then finds the largest family of words which have a permutation
- * of the character guessed (i.e. one family is words that don't contain the character
- * guessed.  The second family might have the letter in the first and third spots, etc.).
+ * HandleSessionCommand
+ * Takes in the server, the worker's partition scratch space, a session, one
+ * line of the server protocol and the time it must be answered by (or 0),
+ * and returns the response line.  The commands are
+ *   NEW <wordLength> <guesses> [dictionary]
+ *                                 start a new game on the session, on the
+ *                                 current version of the named dictionary
+ *                                 (by default the first the server hosts)
+ *   GUESS <letter>                play a turn of the session's game
+ *   STATS [dictionary]            STATS <hits> <misses> <entries> <words>
+ *                                 for the partition cache of the named
+ *                                 dictionary, or else of the session's game
+ *   SAVE                          SAVED <snapshot>, the session's game as
+ *                                 a SaveHangmanGame snapshot in hexadecimal,
+ *                                 unless it has been lost
+ *   RESTORE <snapshot> [dictionary]
+ *                                 carry on a saved game on the session,
+ *                                 on this server or another
+ * and anything that cannot be carried out is answered with ERR <reason>.
+ * Games keep the version of the dictionary they were started or restored
+ * on until the session starts another or closes.  If a replay log is open,
+ * games started with NEW are recorded once they end, or once the session
+ * moves on to another game or closes.  Restored games are not, since their
+ * records would lack the turns played before the snapshot.
  */
+string HandleSessionCommand(GameServer& server, PartitionScratch& partitionScratch, GameSession& session, string command, double deadline) {
+    stringstream converter;
+    converter << command;
+    string verb, dictionaryName;
+    converter >> verb;
+    if (verb == "NEW") {
+        int wordLength, guesses;
+        if (!(converter >> wordLength >> guesses)) return "ERR usage: NEW <wordLength> <guesses> [dictionary]";
+        converter >> dictionaryName;
+        ServedDictionary* servedDictionary = FindServedDictionary(server, dictionaryName);
+        if (servedDictionary == NULL) return "ERR unknown dictionary";
+        WriteReplayRecord(session.replayRecord);
+        ReleaseLoadedDictionary(session.dictionary);
+        session.dictionary = AcquireServedDictionary(*servedDictionary);
+        session.hasGame = StartHangmanGame(session.dictionary->wordBuckets, wordLength, guesses, session.game);
+        if (!session.hasGame) return "ERR no game with that word length and guesses";
+        StartReplayRecord(session.replayRecord, session.dictionary->checksum, wordLength, guesses);
+        return DescribeHangmanGame(session.dictionary->wordBuckets, session.game);
+    } else if (verb == "GUESS") {
+        char guessChar;
+        if (!(converter >> guessChar)) return "ERR usage: GUESS <letter>";
+        guessChar = tolower(guessChar);
+        if (!session.hasGame) return "ERR no game in progress";
+        if (ALPHABET.find(guessChar) == string::npos) return "ERR not a letter";
+        if (session.game.charactersGuessed.find(guessChar) != string::npos) return "ERR already guessed";
+        if (session.game.guessesRemaining <= 0 || IsWordGuessed(session.game.guessedWord)) return "ERR game over";
+        PartitionCache* partitionCache = partitionCacheWords > 0 ? &session.dictionary->partitionCache : NULL;
+        unsigned int familyKey = PlayHangmanGuess(session.dictionary->wordBuckets, session.game, guessChar, partitionScratch, partitionCache, deadline);
+        AddReplayTurn(session.replayRecord, guessChar, familyKey, session.game.possibleWords.size());
+        if (session.game.guessesRemaining == 0 || IsWordGuessed(session.game.guessedWord)) WriteReplayRecord(session.replayRecord);
+        return DescribeHangmanGame(session.dictionary->wordBuckets, session.game);
+    } else if (verb == "STATS") {
+        if (partitionCacheWords == 0) return "ERR no partition cache";
+        LoadedDictionary* dictionary = session.dictionary;
+        if (converter >> dictionaryName || dictionary == NULL) {
+            ServedDictionary* servedDictionary = FindServedDictionary(server, dictionaryName);
+            if (servedDictionary == NULL) return "ERR unknown dictionary";
+            dictionary = servedDictionary->current;
+        }
+        return "STATS " + DescribePartitionCache(dictionary->partitionCache);
+    } else if (verb == "SAVE") {
+        if (!session.hasGame) return "ERR no game in progress";
+        if (session.game.guessesRemaining <= 0) return "ERR game over";
+        string snapshot;
+        SaveHangmanGame(session.dictionary->wordBuckets[session.game.wordLength], session.game, snapshot);
+        return "SAVED " + EncodeHex(snapshot);
+    } else if (verb == "RESTORE") {
+        string snapshotText, snapshot;
+        if (!(converter >> snapshotText) || !DecodeHex(snapshotText, snapshot)) return "ERR usage: RESTORE <snapshot> [dictionary]";
+        converter >> dictionaryName;
+        ServedDictionary* servedDictionary = FindServedDictionary(server, dictionaryName);
+        if (servedDictionary == NULL) return "ERR unknown dictionary";
+        WriteReplayRecord(session.replayRecord);
+        ReleaseLoadedDictionary(session.dictionary);
+        session.dictionary = AcquireServedDictionary(*servedDictionary);
+        session.hasGame = RestoreHangmanGame(session.dictionary->wordBuckets, snapshot, session.game);
+        if (!session.hasGame) return "ERR snapshot is not of a game on this dictionary";
+        return DescribeHangmanGame(session.dictionary->wordBuckets, session.game);
+    }
+    return "ERR unknown command";
+}
 
-set<string> FindLargestWordFamily(char guessChar, set<string> possibleWords) {
-    map<string, set<string> > wordFamilyMap = MakeWordFamilyMap(possibleWords, guessChar);
-    return CountLargestFamily(wordFamilyMap);
+/*
+ * SetNonBlocking
+ * Switches a socket to non-blocking mode, returning false on failure.
+ */
+bool SetNonBlocking(int socket) {
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
 }
-    
-    /*
-     ***** Implementation notes *****
-     make a map map<string, set<string> > wordFamilyMap
-     iterate through the possible words
-        on a word
-            make a string
-                add to the string for each for loop
-            check if the string exists in a map
-            if it does add it to the set
-                else
-            add a new set with the string in it.
-     
-     Iterate over and find the largest set
-     */
 
 /*
- * UpdateGuessesRemaining
- * Processes the player guess by taking in the new and old possible string sets
- * (by reference for efficiency) and determining if the player guessed a correct
- * letter. It then updates the guesses remaining accordingly, printing appropriate
- * messages to the player.
- */
-void UpdateGuessesRemaining(set<string>& newPossibleWords, int& guessesRemaining, char guessChar, string& guessedWord) {
-    set<string>::iterator wordPtr = newPossibleWords.begin();
-    if (wordPtr->find(guessChar) == -1) {
-        cout << "Sorry, incorrect guess. ";
-        PrintGuessesRemaining(--guessesRemaining);
+ * OpenServerSocket
+ * Takes in a server address and returns a non-blocking socket listening on
+ * it, or -1 with a message printed if it cannot be opened.
+ */
+int OpenServerSocket(string address) {
+    sockaddr_storage socketAddress;
+    socklen_t addressLength;
+    if (!MakeSocketAddress(address, socketAddress, addressLength)) {
+        cout << "Invalid server address " << address << endl;
+        return -1;
+    }
+    int listener = socket(socketAddress.ss_family, SOCK_STREAM, 0);
+    int reuse = 1;
+    if (socketAddress.ss_family == AF_UNIX) {
+        unlink(address.c_str());
     } else {
-        cout << "Correct! The word contains " << guessChar << "." << endl;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+    if (listener < 0 || bind(listener, (sockaddr*)&socketAddress, addressLength) != 0 ||
+        listen(listener, SERVER_BACKLOG) != 0 || !SetNonBlocking(listener)) {
+        cout << "Error listening on " << address << endl;
+        if (listener >= 0) close(listener);
+        return -1;
     }
+    return listener;
 }
 
 /*
- * UpdateGuessedWordAndCharactersGuessed
- * Updates the guessedWord and charactersGuessed strings according to the newPossibleWords
- * string set.  All parameters are taken in by reference (the strings to be updated
- * and the set for efficiency) except for the characterGuessed.
+ * ServerWorkerMain
+ * The body of each worker thread.  Takes jobs off the server's pending queue,
+ * answers them and hands them back to the event loop until the server stops.
+ * Every turn the worker plays uses its own partition scratch space.  The
+ * worker's epoch is odd while it answers a job (see WaitForServerWorkers).
  */
-void UpdateGuessedWordAndCharactersGuessed(set<string>& newPossibleWords, string& guessedWord, string& charactersGuessed, char guessChar) {
-    set<string>::iterator pointer = newPossibleWords.begin();
-    
-    for(int i = 0; i < pointer->size(); i++) {
-        if(pointer->at(i) == guessChar) {
-            guessedWord[i] = guessChar;
+void* ServerWorkerMain(void* serverPointer) {
+    GameServer& server = *(GameServer*)serverPointer;
+    long& workerEpoch = server.workerEpochs[__sync_fetch_and_add(&server.nextWorker, 1)];
+    PartitionScratch partitionScratch;
+    size_t largestPool = 0;
+    for (size_t i = 0; i < server.dictionaries.size(); i++) {
+        largestPool = max(largestPool, GetLargestWordBucketSize(server.dictionaries[i].current->wordBuckets));
+    }
+    ReservePartitionScratch(partitionScratch, largestPool);
+    while (true) {
+        pthread_mutex_lock(&server.lock);
+        while (server.pendingJobs.empty() && !server.stopping) {
+            pthread_cond_wait(&server.jobReady, &server.lock);
         }
+        if (server.pendingJobs.empty()) {
+            pthread_mutex_unlock(&server.lock);
+            return NULL;
+        }
+        SessionJob job = server.pendingJobs.front();
+        server.pendingJobs.pop_front();
+        pthread_mutex_unlock(&server.lock);
+        
+        __sync_fetch_and_add(&workerEpoch, 1);
+        job.response = HandleSessionCommand(server, partitionScratch, *job.session, job.command, job.deadline);
+        __sync_fetch_and_add(&workerEpoch, 1);
+        
+        pthread_mutex_lock(&server.lock);
+        server.finishedJobs.push_back(job);
+        pthread_mutex_unlock(&server.lock);
+        char wake = 0;
+        write(server.wakePipe[1], &wake, 1);
     }
-    charactersGuessed += guessChar;
 }
 
 /*
- * IsWordGuessed
- * Takes in a string word and returns false
- * if it contains blank "_" [underscore] characters
- * and returns true if it is a complete word.
+ * DispatchSessionLine
+ * Called on the event loop.  If the session is idle and has a complete line
+ * waiting, takes the line off its input and queues it for the workers.
  */
-bool IsWordGuessed(string guessedWord) {
-    char blank = '_';
-    for(int i; i < guessedWord.size(); i++) {
-        if (guessedWord[i] == blank) return false;
-    }
-    return true;
+void DispatchSessionLine(GameServer& server, GameSession& session) {
+    size_t lineEnd = session.input.find('\n');
+    if (session.busy || session.closing || lineEnd == string::npos) return;
+    SessionJob job;
+    job.session = &session;
+    job.command = session.input.substr(0, lineEnd);
+    job.deadline = turnDeadline > 0 ? GetMicroseconds() + turnDeadline : 0;
+    session.input.erase(0, lineEnd + 1);
+    session.busy = true;
+    pthread_mutex_lock(&server.lock);
+    server.pendingJobs.push_back(job);
+    pthread_cond_signal(&server.jobReady);
+    pthread_mutex_unlock(&server.lock);
 }
 
 /*
- * EndTurn
- * Ends the player turn by taking in set of possible words, the guessesRemaining, wordLength,
- * string of the guessedWord and the boolean for the game completion. It then determines whether
- * the game has ended and prints out appropriate messages to the player before signaling by
- * chaing the boolean, to end the while loop.
+ * RunGameServer
+ * Serves evil hangman games on the address until the process is killed,
+ * from the dictionary files given (the default dictionary if none are).
+ * Each dictionary is loaded once and shared by every session playing on it,
+ * and reloaded in the background when its file changes.  A single event
+ * loop polls all connections and a worker per core plays the turns, each
+ * partitioned on its worker's own thread.
  */
-void EndTurn (set<string>& possibleWords, int guessesRemaining, int wordLength, string guessedWord, bool& gameCompleted) {
-    if (IsWordGuessed(guessedWord)) {
-        cout << "Congratulations! You WIN!" << endl;
-        cout << "The word is ";
-        PrintWordSpaceDelinated(guessedWord);
-        gameCompleted = true;
-    } else if (guessesRemaining == 0) {
-        cout << "Sorry, you lose. The word is: " << endl;
-        set<string>::iterator pointer = possibleWords.begin();
-        PrintWordSpaceDelinated(*pointer);
-        gameCompleted = true;
-    } else {
-        //Do nothing
+int RunGameServer(string address, vector<string>& dictionaryFileNames) {
+    GameServer server;
+    if (dictionaryFileNames.empty()) dictionaryFileNames.push_back(GetDefaultDictionaryFileName());
+    for (size_t i = 0; i < dictionaryFileNames.size(); i++) {
+        ServedDictionary servedDictionary;
+        servedDictionary.name = GetDictionaryName(dictionaryFileNames[i]);
+        servedDictionary.fileName = dictionaryFileNames[i];
+        double loadStart = GetMicroseconds();
+        if (stat(servedDictionary.fileName.c_str(), &servedDictionary.fileStatus) != 0 ||
+            (servedDictionary.current = LoadServedDictionary(servedDictionary.fileName)) == NULL) {
+            cout << "Could not load " << servedDictionary.fileName << endl;
+            return 1;
+        }
+        cout << "Loaded " << servedDictionary.name << " from " << servedDictionary.fileName << " in "
+             << (GetMicroseconds() - loadStart) / 1000 << " ms";
+        if (partitionCacheWords > 0) cout << ", partition cache " << DescribePartitionCache(servedDictionary.current->partitionCache);
+        cout << endl;
+        server.dictionaries.push_back(servedDictionary);
+    }
+    
+    int listener = OpenServerSocket(address);
+    if (listener < 0) return 1;
+    signal(SIGPIPE, SIG_IGN);
+    
+    server.stopping = false;
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.jobReady, NULL);
+    if (pipe(server.wakePipe) != 0 || !SetNonBlocking(server.wakePipe[0])) return 1;
+    
+    long workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workerCount < 1) workerCount = 1;
+    /* Sessions are played in parallel, so turns do not start partition threads of their own */
+    if (workerCount > 1) partitionThreadCount = 1;
+    server.workerEpochs.assign(workerCount, 0);
+    server.nextWorker = 0;
+    vector<pthread_t> workers(workerCount);
+    for (long i = 0; i < workerCount; i++) {
+        pthread_create(&workers[i], NULL, ServerWorkerMain, &server);
+    }
+    pthread_t reloader;
+    pthread_create(&reloader, NULL, DictionaryReloaderMain, &server);
+    cout << "Serving evil hangman on " << address << " with " << workerCount << " workers." << endl;
+    
+    map<int, GameSession*> sessions;
+    vector<pollfd> pollSockets;
+    char readBuffer[SERVER_READ_SIZE];
+    while (true) {
+        /* Watch the listener, the wake pipe and every session */
+        pollSockets.clear();
+        pollfd listenerPoll = {listener, POLLIN, 0};
+        pollfd wakePoll = {server.wakePipe[0], POLLIN, 0};
+        pollSockets.push_back(listenerPoll);
+        pollSockets.push_back(wakePoll);
+        for (map<int, GameSession*>::iterator sessionItr = sessions.begin(); sessionItr != sessions.end(); sessionItr++) {
+            GameSession* session = sessionItr->second;
+            if (session->closing) continue;
+            pollfd sessionPoll = {session->socket, POLLIN, 0};
+            if (!session->output.empty()) sessionPoll.events |= POLLOUT;
+            pollSockets.push_back(sessionPoll);
+        }
+        if (poll(&pollSockets[0], pollSockets.size(), -1) < 0) continue;
+        
+        /* Accept new sessions */
+        if (pollSockets[0].revents & POLLIN) {
+            int connection;
+            while ((connection = accept(listener, NULL, NULL)) >= 0) {
+                SetNonBlocking(connection);
+                GameSession* session = new GameSession;
+                session->socket = connection;
+                session->busy = false;
+                session->closing = false;
+                session->hasGame = false;
+                session->dictionary = NULL;
+                session->replayRecord.recording = false;
+                sessions[connection] = session;
+            }
+        }
+        
+        /* Collect answered jobs */
+        if (pollSockets[1].revents & POLLIN) {
+            while (read(server.wakePipe[0], readBuffer, sizeof(readBuffer)) > 0) {}
+            pthread_mutex_lock(&server.lock);
+            deque<SessionJob> finishedJobs;
+            finishedJobs.swap(server.finishedJobs);
+            pthread_mutex_unlock(&server.lock);
+            for (size_t i = 0; i < finishedJobs.size(); i++) {
+                GameSession* session = finishedJobs[i].session;
+                session->busy = false;
+                session->output += finishedJobs[i].response + "\n";
+                DispatchSessionLine(server, *session);
+            }
+        }
+        
+        /* Read commands and write responses */
+        for (size_t i = 2; i < pollSockets.size(); i++) {
+            GameSession* session = sessions[pollSockets[i].fd];
+            if (pollSockets[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t bytesRead = read(session->socket, readBuffer, sizeof(readBuffer));
+                if (bytesRead > 0) {
+                    session->input.append(readBuffer, bytesRead);
+                    DispatchSessionLine(server, *session);
+                } else if (bytesRead == 0 || errno != EAGAIN) {
+                    session->closing = true;
+                }
+            }
+            if (!session->closing && !session->output.empty()) {
+                ssize_t bytesWritten = write(session->socket, session->output.data(), session->output.size());
+                if (bytesWritten > 0) {
+                    session->output.erase(0, bytesWritten);
+                } else if (bytesWritten < 0 && errno != EAGAIN) {
+                    session->closing = true;
+                }
+            }
+        }
+        
+        /* Drop closed sessions once no worker holds them */
+        for (map<int, GameSession*>::iterator sessionItr = sessions.begin(); sessionItr != sessions.end(); ) {
+            GameSession* session = sessionItr->second;
+            if (session->closing && !session->busy) {
+                close(session->socket);
+                WriteReplayRecord(session->replayRecord);
+                ReleaseLoadedDictionary(session->dictionary);
+                delete session;
+                sessions.erase(sessionItr++);
+            } else {
+                sessionItr++;
+            }
+        }
     }
 }
 
-void PlayTurn(int wordLength, string& guessedWord, set<string>& possibleWords, int& guessesRemaining, string& charactersGuessed, bool displayNumberOfWordsRemaining) {
+/*
+ * RunDictionaryIngest
+ * Streams the words of one length out of a word list of any size with
+ * StreamDictionaryBucket and prints throughput, word counts and peak
+ * resident memory.  With a compiled file name the bucket is written there as
+ * a compiled dictionary holding that one length, for games to map.
+ */
+int RunDictionaryIngest(string fileName, int wordLength, string compiledFileName) {
+    if (wordLength < 1 || wordLength > MAX_WORD_LENGTH) return 1;
+    DictionaryIngest ingest;
+    double startTime = GetMicroseconds();
+    if (!StreamDictionaryBucket(fileName, wordLength, ingest)) return 1;
+    double streamSeconds = (GetMicroseconds() - startTime) * 1e-6;
+    double megabytes = ingest.bytesRead / 1048576.0;
+    cout << "Read " << megabytes << " MB in " << streamSeconds << " s: "
+         << (streamSeconds > 0 ? megabytes / streamSeconds : 0) << " MB/s" << endl;
+    cout << ingest.linesRead << " lines, " << ingest.rejectedWords << " words of length " << wordLength
+         << " rejected, " << ingest.duplicateWords << " duplicates, " << ingest.keptWords.count << " kept" << endl;
     
-    /* Update player */
-    PrintGuessesRemaining(guessesRemaining);
-    PrintWordSpaceDelinated(guessedWord);
-    PrintWordsRemaining(possibleWords, displayNumberOfWordsRemaining);
+    /* Sort the kept words into the order of the compiled dictionary */
+    vector<uint32_t>().swap(ingest.keptWords.slots);
+    vector<IngestBlock>().swap(ingest.blocks);
+    startTime = GetMicroseconds();
+    vector<DictionaryWord> bucketWords(ingest.keptWords.count);
+    for (size_t i = 0; i < bucketWords.size(); i++) {
+        DictionaryWord word = {(uint32_t)(i * wordLength), (uint32_t)wordLength,
+                               GetWordSignature(ingest.bucketText.data() + i * wordLength, wordLength)};
+        bucketWords[i] = word;
+    }
+    DictionaryWordOrder wordOrder = {ingest.bucketText.data(), true};
+    sort(bucketWords.begin(), bucketWords.end(), wordOrder);
+    string compiledData;
+    LayOutCompiledDictionary(ingest.bucketText, bucketWords, compiledData);
+    cout << "Sorted and compiled in " << (GetMicroseconds() - startTime) * 1e-6 << " s" << endl;
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cout << "Peak resident memory " << usage.ru_maxrss << " KB" << endl;
     
-    /* Guessing character */
-    char guessChar = PromptForCharacterGuess(charactersGuessed);
-    set<string> newPossibleWords = FindLargestWordFamily(guessChar, possibleWords);
+    if (compiledFileName.empty()) return 0;
+    ofstream compiledFile(compiledFileName.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!compiledFile.is_open()) {
+        cout << "Error writing " << compiledFileName << endl;
+        return 1;
+    }
+    compiledFile.write(compiledData.data(), compiledData.size());
+    return compiledFile.good() ? 0 : 1;
+}
+
+/*
+ * RunPipedGames
+ * Plays games read from standard input back to back until it ends, each
+ * answering the same prompts as the interactive game, so that scripted games
+ * can be piped through one process.  The dictionary is loaded and the word
+ * buckets and partition scratch set up once for all of them, and output is
+ * only flushed when more input has to be read.  Reports the number of games
+ * and games per second on standard error, leaving standard output to the
+ * games.  Every game is recorded if a replay log is open.
+ */
+int RunPipedGames() {
+    CompiledDictionary compiledDictionary;
+    vector<WordBucket> wordBuckets;
+    LoadWordBuckets(compiledDictionary, wordBuckets);
+    set<int> dictionaryWordLengths;
+    ReadCompiledWordLengths(compiledDictionary, dictionaryWordLengths);
+    PartitionScratch partitionScratch;
+    ReservePartitionScratch(partitionScratch, GetLargestWordBucketSize(wordBuckets));
+    uint64_t dictionaryChecksum = replayLog.file >= 0 ? GetDictionaryChecksum(compiledDictionary) : 0;
     
-    UpdateGuessesRemaining(newPossibleWords, guessesRemaining, guessChar, guessedWord);
-    UpdateGuessedWordAndCharactersGuessed(newPossibleWords, guessedWord, charactersGuessed, guessChar);
-    possibleWords = newPossibleWords;
+    long games = 0;
+    double startTime = GetMicroseconds();
+    string guessedWord, charactersGuessed;
+    CandidateBits candidateBits;
+    ReplayRecord replayRecord;
+    while (HasMoreInput(standardInput)) {
+        int wordLength, guessesRemaining;
+        bool displayNumberOfWordsRemaining;
+        bool gameCompleted = false;
+        PromptForWordLength(dictionaryWordLengths, wordLength);
+        PromptForGuessesRemaining(wordLength, guessesRemaining);
+        PromptForDisplayOfNumberOfWordsRemaining(displayNumberOfWordsRemaining);
+        InitializeGuessedWord(wordLength, guessedWord);
+        charactersGuessed.clear();
+        InitializeCandidateBits(wordBuckets[wordLength], candidateBits);
+        StartReplayRecord(replayRecord, dictionaryChecksum, wordLength, guessesRemaining);
+        while (!gameCompleted) {
+            PlayTurn(wordLength, guessedWord, wordBuckets[wordLength], candidateBits, partitionScratch, guessesRemaining, charactersGuessed, displayNumberOfWordsRemaining, replayRecord);
+            EndTurn(wordBuckets[wordLength], candidateBits, guessesRemaining, wordLength, guessedWord, gameCompleted);
+        }
+        WriteReplayRecord(replayRecord);
+        games++;
+    }
+    cout.flush();
+    double seconds = (GetMicroseconds() - startTime) * 1e-6;
+    cerr << games << " games in " << seconds << " s: " << (seconds > 0 ? games / seconds : 0) << " games/s" << endl;
+    UnmapCompiledDictionary(compiledDictionary);
+    return 0;
 }
 
 
 /* Main function */
 
-int main () {
+int main (int argc, char* argv[]) {
+    /* Games write through cout's own buffer, flushed whenever input is read */
+    ios::sync_with_stdio(false);
+    
+    /* Partition tuning, metrics export and the replay log may lead any command */
+    if (!ReadCommandOptions(argc, argv)) return 1;
+    
+    /* Offline dictionary compilation */
+    if (argc > 1 && string(argv[1]) == "-compile") {
+        string dictionaryFileName = argc > 2 ? argv[2] : HANGMAN_DICTIONARY;
+        string compiledFileName = argc > 3 ? argv[3] : COMPILED_HANGMAN_DICTIONARY;
+        return CompileDictionary(dictionaryFileName, compiledFileName) ? 0 : 1;
+    }
+    
+    /* Offline opening book */
+    if (argc > 1 && string(argv[1]) == "-book") {
+        string dictionaryFileName = argc > 2 ? argv[2] : HANGMAN_DICTIONARY;
+        string bookFileName = argc > 3 ? argv[3] : OPENING_BOOK;
+        return BuildOpeningBook(dictionaryFileName, bookFileName) ? 0 : 1;
+    }
+    
+    /* Streaming one word length out of a large word list */
+    if (argc > 3 && string(argv[1]) == "-ingest") {
+        return RunDictionaryIngest(argv[2], atoi(argv[3]), argc > 4 ? argv[4] : "");
+    }
+    
+    /* Scripted games piped through standard input */
+    if (argc > 1 && string(argv[1]) == "-pipe") {
+        return RunPipedGames();
+    }
+    
+    /* Game server */
+    if (argc > 2 && string(argv[1]) == "-serve") {
+        vector<string> dictionaryFileNames(argv + 3, argv + argc);
+        return RunGameServer(argv[2], dictionaryFileNames);
+    }
+    
     /* Dictionary */
-    ifstream dictionaryFile;
-    set<string> dictionarySet;
+    CompiledDictionary compiledDictionary;
     set<int> dictionaryWordLengths;
     
     /* States */ 
     int wordLength, guessesRemaining;
     string guessedWord;
     string charactersGuessed = "";
-    set<string> possibleWords;
+    WordBucket wordBucket;
+    CandidateBits candidateBits;
+    PartitionScratch partitionScratch;
+    ReplayRecord replayRecord;
     bool displayNumberOfWordsRemaining;
     bool gameCompleted = false;
     
     /* Initialize the hangman game */
-    InitializeHangmanGame(dictionaryFile, dictionarySet, dictionaryWordLengths, wordLength, guessedWord, possibleWords, guessesRemaining, displayNumberOfWordsRemaining);
+    InitializeHangmanGame(compiledDictionary, dictionaryWordLengths, wordLength, guessedWord, wordBucket, candidateBits, partitionScratch, guessesRemaining, displayNumberOfWordsRemaining);
+    StartReplayRecord(replayRecord, replayLog.file >= 0 ? GetDictionaryChecksum(compiledDictionary) : 0, wordLength, guessesRemaining);
     
     /* Play hangman turns */
     while (!gameCompleted) {
-        PlayTurn(wordLength, guessedWord, possibleWords, guessesRemaining, charactersGuessed,displayNumberOfWordsRemaining);
-        EndTurn(possibleWords, guessesRemaining, wordLength, guessedWord, gameCompleted);
+        PlayTurn(wordLength, guessedWord, wordBucket, candidateBits, partitionScratch, guessesRemaining, charactersGuessed,displayNumberOfWordsRemaining, replayRecord);
+        EndTurn(wordBucket, candidateBits, guessesRemaining, wordLength, guessedWord, gameCompleted);
     }
+    WriteReplayRecord(replayRecord);
     
+    UnmapCompiledDictionary(compiledDictionary);
     return 0;
 }
 
@@ -581,4 +1303,4 @@ int main () {
  vector, map, stack, queque
  
  
- */
\ No newline at end of file
+ */